@@ -0,0 +1,135 @@
+// Decode time-lapse frame files written with --frames into one PPM per frame.
+// MPI runs write one file per rank, pass all of them to stitch the blocks.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sandpile/include/frames.h"
+
+typedef struct {
+    FILE *file;
+    FramesHeader header;
+    int next_pass; // Pass of the next unread frame, -1 at end of file
+} FrameFile;
+
+static void read_next_pass(FrameFile *f) {
+    int32_t pass;
+    f->next_pass = fread(&pass, sizeof(int32_t), 1, f->file) == 1 ? pass : -1;
+}
+
+// Apply the next frame of f to the global image
+static int apply_frame(FrameFile *f, unsigned char *image, int global_cols) {
+    int32_t size;
+    if (fread(&size, sizeof(int32_t), 1, f->file) != 1) return 1;
+    unsigned char *payload = (unsigned char*)malloc(size);
+    if (fread(payload, 1, size, f->file) != (size_t)size) {
+        free(payload);
+        return 1;
+    }
+
+    const FramesHeader *h = &f->header;
+    int tiles_rows = (h->rows + h->tile - 1) / h->tile;
+    int tiles_cols = (h->cols + h->tile - 1) / h->tile;
+    size_t n = 0;
+    for (int tr = 0; tr < tiles_rows; tr++) {
+        for (int tc = 0; tc < tiles_cols; tc++) {
+            unsigned char mode = payload[n++];
+            if (mode == FRAME_TILE_SAME) continue;
+
+            int32_t bytes;
+            memcpy(&bytes, payload + n, sizeof(int32_t));
+            n += sizeof(int32_t);
+            size_t end = n + bytes;
+
+            int r0 = tr * h->tile;
+            int c0 = tc * h->tile, c1 = c0 + h->tile > h->cols ? h->cols : c0 + h->tile;
+            int i = r0, j = c0;
+            while (n < end) {
+                int count = payload[n++];
+                unsigned char value = payload[n++];
+                for (int k = 0; k < count; k++) {
+                    image[(size_t)(h->origin_row + i) * global_cols + h->origin_col + j] = value;
+                    if (++j == c1) {
+                        j = c0;
+                        i++;
+                    }
+                }
+            }
+        }
+    }
+    free(payload);
+    return 0;
+}
+
+// Same colours as visualize_grid_as_image, cells that are still unstable are white
+static void write_ppm(const char *filename, const unsigned char *image, int rows, int cols) {
+    FILE *file = fopen(filename, "wb");
+    if (!file) {
+        perror("Failed to open file for writing.");
+        return;
+    }
+    static const unsigned char colours[4][3] = {{0, 0, 0}, {0, 255, 0}, {0, 0, 255}, {255, 0, 0}};
+    static const unsigned char white[3] = {255, 255, 255};
+
+    fprintf(file, "P6\n%d %d\n255\n", cols, rows);
+    for (size_t i = 0; i < (size_t)rows * cols; i++) {
+        fwrite(image[i] < 4 ? colours[image[i]] : white, 1, 3, file);
+    }
+    fclose(file);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s output_prefix frames_file [frames_file ...]\n", argv[0]);
+        return 1;
+    }
+
+    int num_files = argc - 2;
+    FrameFile *files = (FrameFile*)calloc(num_files, sizeof(FrameFile));
+    for (int f = 0; f < num_files; f++) {
+        files[f].file = fopen(argv[f + 2], "rb");
+        if (!files[f].file || fread(&files[f].header, sizeof(FramesHeader), 1, files[f].file) != 1 ||
+            memcmp(files[f].header.magic, FRAMES_MAGIC, 4) != 0) {
+            fprintf(stderr, "Not a frames file: %s\n", argv[f + 2]);
+            return 1;
+        }
+        read_next_pass(&files[f]);
+    }
+
+    int rows = files[0].header.global_rows;
+    int cols = files[0].header.global_cols;
+    unsigned char *image = (unsigned char*)calloc((size_t)rows * cols, 1);
+
+    // Frames are merged by pass, a block without a frame for a pass keeps its last state
+    int frames = 0;
+    for (;;) {
+        int pass = -1;
+        for (int f = 0; f < num_files; f++) {
+            if (files[f].next_pass >= 0 && (pass < 0 || files[f].next_pass < pass)) {
+                pass = files[f].next_pass;
+            }
+        }
+        if (pass < 0) break;
+
+        for (int f = 0; f < num_files; f++) {
+            if (files[f].next_pass == pass) {
+                if (apply_frame(&files[f], image, cols)) {
+                    fprintf(stderr, "Truncated frame in %s\n", argv[f + 2]);
+                    files[f].next_pass = -1;
+                    continue;
+                }
+                read_next_pass(&files[f]);
+            }
+        }
+
+        char filename[512];
+        snprintf(filename, sizeof(filename), "%s_%06d.ppm", argv[1], pass);
+        write_ppm(filename, image, rows, cols);
+        frames++;
+    }
+    printf("Decoded %d frames\n", frames);
+
+    for (int f = 0; f < num_files; f++) fclose(files[f].file);
+    free(files);
+    free(image);
+    return 0;
+}
@@ -0,0 +1,316 @@
+// Microbenchmarks for the toppling kernels on their own, without allocation,
+// output or scheduling: async_new_tile (serial), process_tile (OpenMP),
+// local_sandpile_iteration (MPI) and the synch engine's row kernel at each
+// SIMD level this CPU runs, on grids sized for each cache level and DRAM.
+//
+// Every sample starts from the same random grid, so each sweep does exactly the
+// same work and the statistics only see timing noise. Kernels run on one
+// thread and are compared with a single thread STREAM triad: bytes per cell
+// visit are modelled as one read and one write back of the cell, so the
+// bandwidth bound is 2 * sizeof(cell) / triad bandwidth per visit. Every
+// kernel runs on the cells of a Grid, as the engines do.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include "sandpile/include/grid.h"
+#include "sandpile/include/sandpile.h"
+#include "sandpile/include/initial.h"
+#include "sandpile/include/simd.h"
+#include "sandpile/include/tiled.h"
+#include "sandpile/include/distributed.h"
+
+#define DEFAULT_REPEATS 15
+#define WARMUP 2
+#define MIN_VISITS 4000000L // Cell visits per sample, keeps samples well above timer resolution
+#define MAX_SIZES 16
+
+typedef struct Sample {
+    double seconds; // One sample: sweeps from the pristine grid
+    long visits;
+    long topples;
+} Sample;
+
+typedef struct Stats {
+    double median, min, mean, stddev, mad; // ns per cell visit
+} Stats;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static Stats summarise(double *values, int n) {
+    Stats stats;
+    qsort(values, n, sizeof(double), compare_doubles);
+    stats.min = values[0];
+    stats.median = n % 2 ? values[n / 2] : 0.5 * (values[n / 2 - 1] + values[n / 2]);
+
+    double sum = 0, squares = 0;
+    for (int i = 0; i < n; i++) sum += values[i];
+    stats.mean = sum / n;
+    for (int i = 0; i < n; i++) squares += (values[i] - stats.mean) * (values[i] - stats.mean);
+    stats.stddev = n > 1 ? sqrt(squares / (n - 1)) : 0;
+
+    // Median absolute deviation, not thrown off by the odd descheduled sample
+    double *deviations = (double*)malloc(n * sizeof(double));
+    for (int i = 0; i < n; i++) deviations[i] = fabs(values[i] - stats.median);
+    qsort(deviations, n, sizeof(double), compare_doubles);
+    stats.mad = n % 2 ? deviations[n / 2] : 0.5 * (deviations[n / 2 - 1] + deviations[n / 2]);
+    free(deviations);
+    return stats;
+}
+
+// Single thread STREAM triad a = b + s * c, in GB/s counting 24 bytes per element
+static double stream_triad(size_t n, int repeats) {
+    double *a = (double*)malloc(n * sizeof(double));
+    double *b = (double*)malloc(n * sizeof(double));
+    double *c = (double*)malloc(n * sizeof(double));
+    for (size_t i = 0; i < n; i++) {
+        a[i] = 0;
+        b[i] = 1;
+        c[i] = 2;
+    }
+
+    double best = 1e30;
+    for (int r = 0; r < repeats; r++) {
+        double start = now();
+        for (size_t i = 0; i < n; i++) {
+            a[i] = b[i] + 3.0 * c[i];
+        }
+        double t = now() - start;
+        if (t < best) best = t;
+    }
+    // Keep the stores observable
+    if (a[n / 2] != 7.0) printf("STREAM check failed\n");
+    free(a); free(b); free(c);
+    return 3.0 * sizeof(double) * n / best * 1e-9;
+}
+
+// Pristine load: uniform in [0, 7], so about half the cells topple on the first sweep
+static void fill_pristine(unsigned int *cells, int rows, int cols) {
+    InitialCondition init;
+    initial_default(&init);
+    init.kind = INIT_UNIFORM;
+    init.max = 7;
+    init.seed = 42;
+    for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < cols; j++) {
+            cells[(size_t)i * cols + j] = (unsigned int)initial_value(&init, i, j, cols);
+        }
+    }
+}
+
+static void load_serial_grid(Grid *grid, const unsigned int *pristine) {
+    int rows = grid->rows, cols = grid->cols;
+    for (int i = 0; i <= rows + 1; i++) {
+        for (int j = 0; j <= cols + 1; j++) {
+            grid->sandpile[i][j] = 0;
+        }
+    }
+    for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < cols; j++) {
+            grid->sandpile[i + 1][j + 1] = pristine[(size_t)i * cols + j];
+        }
+    }
+}
+
+// Cells of tile (tile_row, tile_col), the last tiles of a row or column are cut short
+static long tile_cells(int tile_row, int tile_col, int rows, int cols) {
+    int tile_rows = rows - tile_row * TILE_SIZE < TILE_SIZE ? rows - tile_row * TILE_SIZE : TILE_SIZE;
+    int tile_cols = cols - tile_col * TILE_SIZE < TILE_SIZE ? cols - tile_col * TILE_SIZE : TILE_SIZE;
+    return (long)tile_rows * tile_cols;
+}
+
+typedef enum Kernel {
+    KERNEL_ASYNC, KERNEL_TILE, KERNEL_LOCAL, KERNEL_SYNCH_SCALAR, KERNEL_SYNCH_AVX2, KERNEL_SYNCH_AVX512, NUM_KERNELS
+} Kernel;
+static const char *kernel_names[NUM_KERNELS] = {"async_new_tile", "process_tile", "local_sandpile_iteration",
+                                                "synch_row_scalar", "synch_row_avx2", "synch_row_avx512"};
+// The synch kernels read one buffer and write the other, also one read and
+// one write per visit
+#define CELL_BYTES sizeof(unsigned long int)
+
+// Runs sweeps first sweeps of kernel from the pristine grid, only the sweeps
+// are timed. The synch kernels write their pass into next
+static Sample run_sample(Kernel kernel, int rows, int cols, int sweeps, const unsigned int *pristine,
+                         Grid *serial, Grid *next) {
+    Sample sample = {0, 0, 0};
+    for (int s = 0; s < sweeps; s++) {
+        double start = 0;
+        long topples = 0;
+        switch (kernel) {
+        case KERNEL_ASYNC:
+            load_serial_grid(serial, pristine);
+            start = now();
+            for (int y = 1; y <= rows; y++) {
+                for (int x = 1; x <= cols; x++) {
+                    topples += async_new_tile(x, y, serial);
+                }
+            }
+            sample.seconds += now() - start;
+            sample.visits += (long)rows * cols;
+            break;
+        case KERNEL_TILE: {
+            load_serial_grid(serial, pristine);
+            int tiles_rows = (rows + TILE_SIZE - 1) / TILE_SIZE;
+            int tiles_cols = (cols + TILE_SIZE - 1) / TILE_SIZE;
+            long visits = 0;
+            start = now();
+            for (int tr = 0; tr < tiles_rows; tr++) {
+                for (int tc = 0; tc < tiles_cols; tc++) {
+                    int sweeps;
+                    topples += process_tile(serial, tr, tc, TILE_SIZE, &sweeps, NULL);
+                    visits += (long)sweeps * tile_cells(tr, tc, rows, cols);
+                }
+            }
+            sample.seconds += now() - start;
+            sample.visits += visits;
+            break;
+        }
+        case KERNEL_LOCAL: {
+            load_serial_grid(serial, pristine);
+            Box box = {1, rows, 1, cols};
+            start = now();
+            topples = local_sandpile_iteration(serial, &box);
+            sample.seconds += now() - start;
+            sample.visits += (long)rows * cols;
+            break;
+        }
+        case KERNEL_SYNCH_SCALAR:
+        case KERNEL_SYNCH_AVX2:
+        case KERNEL_SYNCH_AVX512: {
+            SynchRowKernel row_kernel = synch_row_kernel((SimdLevel)(kernel - KERNEL_SYNCH_SCALAR));
+            load_serial_grid(serial, pristine);
+            unsigned long int **in = serial->sandpile;
+            start = now();
+            for (int y = 1; y <= rows; y++) {
+                topples += row_kernel(in[y - 1], in[y], in[y + 1], NULL, NULL, next->sandpile[y], cols);
+            }
+            sample.seconds += now() - start;
+            sample.visits += (long)rows * cols;
+            break;
+        }
+        default:
+            break;
+        }
+        sample.topples += topples;
+    }
+    return sample;
+}
+
+static const char* cache_level(size_t bytes) {
+    long l1 = sysconf(_SC_LEVEL1_DCACHE_SIZE);
+    long l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    long l3 = sysconf(_SC_LEVEL3_CACHE_SIZE);
+    if (l1 > 0 && bytes <= (size_t)l1) return "L1";
+    if (l2 > 0 && bytes <= (size_t)l2) return "L2";
+    if (l3 > 0 && bytes <= (size_t)l3) return "L3";
+    return l3 > 0 ? "DRAM" : "?";
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [--sizes N,N,...] [--repeats R] [--stream-mb MB] [--csv FILE]\n", prog);
+    fprintf(stderr, "  square grids of each size N, default 32,128,512,4096\n");
+    fprintf(stderr, "  the csv gets kernel,size,fits,sweeps,repeats,median,min,mean,stddev,mad,\n");
+    fprintf(stderr, "  ns_per_topple,gbs lines appended, times in ns per cell visit\n");
+}
+
+int main(int argc, char *argv[]) {
+    int sizes[MAX_SIZES] = {32, 128, 512, 4096};
+    int num_sizes = 4;
+    int repeats = DEFAULT_REPEATS;
+    size_t stream_mb = 256;
+    const char *csv_file = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--sizes") == 0 && i + 1 < argc) {
+            num_sizes = 0;
+            for (char *p = argv[++i]; *p && num_sizes < MAX_SIZES; ) {
+                sizes[num_sizes++] = (int)strtol(p, &p, 10);
+                if (*p == ',') p++;
+            }
+        } else if (strcmp(argv[i], "--repeats") == 0 && i + 1 < argc) {
+            repeats = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--stream-mb") == 0 && i + 1 < argc) {
+            stream_mb = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--csv") == 0 && i + 1 < argc) {
+            csv_file = argv[++i];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    for (int s = 0; s < num_sizes; s++) {
+        if (sizes[s] <= 0) {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (repeats < 3) repeats = 3;
+
+    // Three arrays of stream_mb / 3 each, well beyond the last level cache by default
+    double triad = stream_triad(stream_mb * 1024 * 1024 / 3 / sizeof(double), 10);
+    printf("STREAM triad, 1 thread: %.2f GB/s\n\n", triad);
+    printf("%-26s %6s %5s %6s %9s %9s %7s %9s %7s %8s %6s\n", "kernel", "size", "fits", "sweeps",
+           "ns/visit", "min", "MAD%", "ns/topple", "GB/s", "bound ns", "%peak");
+
+    FILE *csv = csv_file ? fopen(csv_file, "a") : NULL;
+    if (csv_file && !csv) perror("Failed to open csv file");
+
+    double *ns_visit = (double*)malloc((repeats + WARMUP) * sizeof(double));
+    for (int s = 0; s < num_sizes; s++) {
+        int n = sizes[s];
+        unsigned int *pristine = (unsigned int*)malloc((size_t)n * n * sizeof(unsigned int));
+        fill_pristine(pristine, n, n);
+        Grid *serial = grid_create(n, n, 1, 0, 0);
+        Grid *next = grid_create(n, n, 1, 0, 0);
+        if (serial == NULL || next == NULL) return 1;
+        for (int k = 0; k < NUM_KERNELS; k++) {
+            // Instruction sets this CPU or lattice lacks are left out
+            if (k >= KERNEL_SYNCH_SCALAR && !synch_row_kernel((SimdLevel)(k - KERNEL_SYNCH_SCALAR))) continue;
+            // process_tile sweeps each tile until it is stable, so visits per
+            // sweep are measured rather than taken to be the cell count
+            Sample sample = run_sample((Kernel)k, n, n, 1, pristine, serial, next);
+            int sweeps = (int)((MIN_VISITS + sample.visits - 1) / sample.visits);
+            for (int r = 0; r < repeats + WARMUP; r++) {
+                sample = run_sample((Kernel)k, n, n, sweeps, pristine, serial, next);
+                ns_visit[r] = sample.seconds * 1e9 / sample.visits;
+            }
+            // Every sample does the same work, so the counts of the last one hold for all
+            Stats stats = summarise(ns_visit + WARMUP, repeats);
+            double visits_per_topple = sample.topples ? (double)sample.visits / sample.topples : 0;
+            double bytes = 2.0 * CELL_BYTES;
+            double gbs = bytes / stats.median;
+            double bound = bytes / triad;
+            const char *fits = cache_level((size_t)(n + 2) * (n + 2) * CELL_BYTES);
+
+            printf("%-26s %6d %5s %6d %9.3f %9.3f %7.2f %9.3f %7.2f %8.3f %6.1f\n", kernel_names[k], n,
+                   fits, sweeps, stats.median, stats.min, 100.0 * stats.mad / stats.median,
+                   stats.median * visits_per_topple, gbs, bound, 100.0 * gbs / triad);
+            if (csv) {
+                fprintf(csv, "%s,%d,%s,%d,%d,%f,%f,%f,%f,%f,%f,%f\n", kernel_names[k], n, fits, sweeps,
+                        repeats, stats.median, stats.min, stats.mean, stats.stddev, stats.mad,
+                        stats.median * visits_per_topple, gbs);
+            }
+        }
+        free(pristine);
+        grid_free(serial);
+        grid_free(next);
+    }
+    printf("\nns/visit is the median over %d samples after %d warmup, MAD%% its median absolute deviation.\n",
+           repeats, WARMUP);
+    printf("GB/s and the bound assume 2 x cell size bytes per visit, one read and one write back.\n");
+
+    if (csv) fclose(csv);
+    free(ns_visit);
+    return 0;
+}
@@ -0,0 +1,66 @@
+// Order-independent checksum of a final grid, so the serial, OpenMP and MPI
+// versions can be compared without writing or diffing the grid itself
+// guards prevent multiple inclusions
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "grid.h"
+
+#define CHECKSUM_BINS 5   // Cells holding 0, 1, 2, 3 and 4 or more grains
+#define CHECKSUM_WORDS 7  // uint64 words in a GridChecksum, for reductions
+
+// Every field is a sum over cells, so partial checksums of any split of the
+// grid (threads, tiles, ranks) add up to the same result
+typedef struct GridChecksum {
+    uint64_t hash;   // Sum of a hash of (global index, value) per cell
+    uint64_t grains;
+    uint64_t histogram[CHECKSUM_BINS];
+} GridChecksum;
+
+// SplitMix64 finaliser
+static inline uint64_t checksum_mix(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+// Contribution of global row-major cell index holding value
+static inline uint64_t checksum_cell(uint64_t index, uint64_t value) {
+    return checksum_mix(checksum_mix(index) + value);
+}
+
+// Checksum file key of a run: the initial condition's fingerprint, mixed with
+// the lattice and depth on anything but the square lattice so runs of
+// different lattices are never compared
+static inline uint64_t checksum_run_key(uint64_t init_key, int depth) {
+    if (LATTICE_ID == 0 && depth == 1) return init_key;
+    return checksum_mix(init_key ^ checksum_mix(((uint64_t)LATTICE_ID << 32) | (uint32_t)depth));
+}
+
+void checksum_clear(GridChecksum *sum);
+void checksum_merge(GridChecksum *into, const GridChecksum *from);
+int checksum_equal(const GridChecksum *a, const GridChecksum *b);
+// Partial checksum of grid as the block of a global_rows x global_cols grid
+// starting at global (origin_row, origin_col), the whole grid when the origin
+// is 0 and the global size is the grid's
+void checksum_from_block(Grid *grid, int origin_row, int origin_col, int global_rows, int global_cols,
+                         GridChecksum *sum);
+void checksum_print(const GridChecksum *sum);
+
+// Checksum csv, one line per run written next to its timing:
+// version,threads,rows,cols,centre,allVal,init,hash,grains,n0,n1,n2,n3,n4plus
+void checksums_append(FILE *file, const char *version, int threads, int rows, int cols,
+                      unsigned long int centre, unsigned long int allVal, uint64_t init,
+                      const GridChecksum *sum);
+// Parses a line written by checksums_append, the version is truncated to
+// version_size. Returns 0 on success
+int checksums_parse(const char *line, char *version, size_t version_size, int *threads, int *rows,
+                    int *cols, unsigned long int *centre, unsigned long int *allVal, uint64_t *init,
+                    GridChecksum *sum);
+
+#endif
@@ -0,0 +1,22 @@
+// MPI engine: a 2D process grid where every rank owns a block of the grid
+// with one ghost cell on each side, grains pushed into the ghost cells are
+// forwarded to the neighbouring ranks after each local pass. 2D lattices only
+#include "grid.h"
+#include "engine.h"
+// guards prevent multiple inclusions
+#ifndef DISTRIBUTED_H
+#define DISTRIBUTED_H
+
+// One local pass over the cells of box, which may reach into the ghost
+// layer. Afterwards box is the toppled box grown by one, so it reaches into
+// the ghost layer when grains were pushed there, empty when top > bottom.
+// Returns the number of cells toppled
+long local_sandpile_iteration(Grid *grid, Box *box);
+// Temporally blocked local pass: each block_size x block_size block is swept
+// up to time_steps times while cache resident. Returns the number of topples,
+// unstable gets the cells toppled by the first sweep of each block
+long local_sandpile_blocked(Grid *grid, Box *box, int block_size, int time_steps, long *unstable);
+
+extern const Engine mpi_engine;
+
+#endif
@@ -0,0 +1,97 @@
+// Toppling engines behind one interface, picked at run time with --engine.
+// Every engine stabilises a Grid in place, the whole grid or, for the MPI
+// engine, the block of it one rank owns. engine_main runs the configurations
+// and writes the results, checksums, images and grid files the same way
+// whichever engine ran, the hooks only cover what differs between engines
+#include <stdio.h>
+#include <stdbool.h>
+#include "grid.h"
+#include "options.h"
+#include "simd.h"
+#include "checksum.h"
+#include "frames.h"
+#include "passlog.h"
+#include "progress.h"
+// guards prevent multiple inclusions
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#define DEFAULT_ENGINE "asynch"
+
+// Engine capabilities, options an engine does not support are rejected
+#define ENGINE_SIMD 1        // Runs a row kernel, the version names its level
+#define ENGINE_THREADED 2    // OpenMP threads, one progress slot each
+#define ENGINE_DISTRIBUTED 4 // MPI ranks each own a block, per rank frames and progress files
+#define ENGINE_BLOCKED 8     // Takes --blocked, for a blocked variant or because it is one
+#define ENGINE_PASS_LOG 16   // Counts the topples of every pass for --pass-log
+#define ENGINE_FRAMES 32     // Captures --frames
+
+typedef struct EngineStats {
+    int passes;    // Including the last pass that found the grid stable
+    long topples;
+    double seconds;
+    int threads;   // For the results file, ranks for the MPI engine
+} EngineStats;
+
+// State of a run shared by engine_main and the engine's hooks
+typedef struct EngineRun {
+    const SandpileOptions *opts;
+    SimdLevel level;
+    char version[64];             // e.g. "SerialBlockedMoore" or "SynchAVX512"
+    bool batch;                   // Only time the configurations, no per run outputs
+    Grid *grid;                   // Block of this process, the whole grid unless distributed
+    int global_rows, global_cols; // Size of the current configuration
+    int origin_row, origin_col;   // Global position of the block's first cell
+    int rank, ranks;              // 0 and 1 unless distributed, rank 0 prints and writes the csv files
+    FrameWriter *frames;          // NULL unless frames are captured
+    ProgressMonitor *progress;    // NULL unless --progress
+    PassLog *pass_log;            // NULL unless --pass-log
+    void *state;                  // Private to the engine, kept across configurations
+} EngineRun;
+
+// Hooks left NULL do the single process thing on the whole grid
+typedef struct Engine {
+    const char *name;            // Value of --engine
+    const char *version;         // Start of the version in results and checksums
+    const char *blocked_version; // Version with --blocked, NULL if it needs no other name
+    const char *blocked_engine;  // Engine --blocked switches to, NULL to stay on this one
+    const char *description;
+    const char *image_file;      // PPM written unless --pyramid
+    int flags;                   // ENGINE_ capabilities
+    // Once before the first configuration, sets rank, ranks and state. Returns 0 on success
+    int (*open)(EngineRun *run);
+    // Places this process's block in the configuration and loads it with
+    // engine_load. Returns 0 on success
+    int (*init)(EngineRun *run, const RunConfig *config);
+    // Returns 0 on success
+    int (*stabilize)(EngineRun *run, EngineStats *stats);
+    // Turns the stats of this process into those of the whole run
+    void (*stats)(EngineRun *run, EngineStats *stats);
+    // Outputs of the whole grid from the blocks, called by every process
+    void (*checksum)(EngineRun *run, GridChecksum *sum); // Needed on rank 0 only
+    void (*image)(EngineRun *run, const char *filename);
+    void (*pyramid)(EngineRun *run, const char *dir);
+    void (*save)(EngineRun *run, const char *filename);
+    void (*close)(EngineRun *run);
+} Engine;
+
+// Adds an engine to the built-in serial and OpenMP ones. The MPI engine lives
+// in libsandpile_mpi, so only the programs linked with it register it, before
+// engine_main
+void engine_register(const Engine *engine);
+// Engine and SIMD level from --engine, --blocked, --wavefront and --simd.
+// Without --engine it is the registered MPI engine when started by mpirun,
+// otherwise default_engine. A level the CPU or lattice cannot run falls back to the
+// best one that it can, with a warning. Returns NULL after printing the reason
+const Engine* engine_select(const SandpileOptions *opts, const char *default_engine, SimdLevel *level);
+// e.g. "SerialBlockedMoore", "SynchAVX512" or "MPIBlocked"
+void engine_version(const Engine *engine, const SandpileOptions *opts, SimdLevel level, char *buffer, size_t size);
+void engine_list(FILE *file);
+// Sizes run->grid for the rows x cols block at run->origin of the
+// configuration and fills it from the configuration and --init. Returns 0 on success
+int engine_load(EngineRun *run, const RunConfig *config, int rows, int cols);
+// The whole program: options, configurations, the engine's run and outputs.
+// The executables only differ in default_engine
+int engine_main(int argc, char *argv[], const char *default_engine);
+
+#endif
@@ -0,0 +1,49 @@
+// Time-lapse capture: frames are handed to a background writer thread that
+// delta encodes them per tile into a single container file
+// guards prevent multiple inclusions
+#ifndef FRAMES_H
+#define FRAMES_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "grid.h"
+
+#define FRAMES_MAGIC "SPF1"
+#define FRAMES_TILE 32
+#define FRAMES_QUEUE 4 // Frames buffered ahead of the writer thread
+
+// Tile encodings in a frame record
+#define FRAME_TILE_SAME 0 // Identical to the previous frame
+#define FRAME_TILE_RLE 1  // (count, value) byte pairs
+
+// Container header, followed by frame records of
+// pass (int32), payload size (int32) and one entry per tile in row-major order
+typedef struct FramesHeader {
+    char magic[4];
+    int32_t global_rows, global_cols; // Size of the whole grid
+    int32_t origin_row, origin_col;   // Where this file's block starts
+    int32_t rows, cols;               // Size of this file's block
+    int32_t tile;
+} FramesHeader;
+
+typedef struct FrameWriter FrameWriter;
+
+// With wait set, a frame begun while FRAMES_QUEUE frames are queued waits for
+// the writer, otherwise it is dropped so compute never waits on I/O
+FrameWriter* frames_open(const char *filename, int global_rows, int global_cols,
+                         int origin_row, int origin_col, int rows, int cols, int wait);
+// Returns the rows x cols buffer to fill with the next frame (values clamped to
+// 255), or NULL when the frame is dropped because the queue is full
+unsigned char* frames_begin(FrameWriter *writer);
+// Like frames_begin for the final state once the run is over, which is never
+// dropped and so may wait. Returns NULL if pass was already submitted
+unsigned char* frames_begin_final(FrameWriter *writer, int pass);
+// Hands the buffer returned by frames_begin to the writer thread
+void frames_submit(FrameWriter *writer, int pass);
+// Copies the grid into a frame every every passes, the last pass is always
+// captured. Does nothing when writer is NULL
+void frames_capture(FrameWriter *writer, Grid *grid, int every, int pass, bool last);
+// Waits for the last frame to be written and closes the file
+void frames_close(FrameWriter *writer);
+
+#endif
@@ -1,5 +1,8 @@
 // 2d grid representing the sandpile
 #include <stdbool.h>
+#include <stddef.h>
+#include "initial.h"
+#include "lattice.h"
 // guards prevent multiple inclusions
 #ifndef GRID_H 
 #define GRID_H
@@ -7,12 +10,46 @@
 typedef struct Grid {
     int rows;
     int cols;
-    unsigned long int **sandpile; // Double pointer for 2D array
+    int depth;                    // z layers of the cubic lattice, 1 otherwise
+    unsigned long int **sandpile; // Double pointer for 2D array, the central layer in 3D
+    unsigned long int **layers;   // Rows of every layer, layer z starts at z * layer_stride
+    int layer_stride;             // rows + 2
+    unsigned long int *cells;     // Storage the rows point into
+    size_t capacity;              // Cells allocated, grows to the largest grid
+    int row_capacity;
 } Grid;
 
-// grid_create uses malloc so must return memory address assigned
-Grid* grid_create(int rows, int cols, unsigned long int centre, unsigned long int allVal); 
+// Layers holding cells: 1 to depth on the cubic lattice, between two ghost
+// layers, and only layer 0 on the 2D lattices where layers == sandpile
+#define GRID_FIRST_LAYER (LATTICE_3D ? 1 : 0)
+#define GRID_LAST_LAYER(grid) (LATTICE_3D ? (grid)->depth : 0)
+#define GRID_LAYERS(depth) (LATTICE_3D ? (depth) + 2 : 1)
+
+// Inclusive bounding box of cells, empty when top > bottom
+typedef struct Box {
+    int top;
+    int bottom;
+    int left;
+    int right;
+} Box;
+
+// grid_create uses malloc so must return memory address assigned, NULL if it fails
+Grid* grid_create(int rows, int cols, int depth, unsigned long int centre, unsigned long int allVal); 
+// Sizes the storage and row pointers for a rows x cols grid (every layer in
+// 3D), leaving the cells as they are. Returns 1 if the storage could not grow
+int grid_resize(Grid *grid, int rows, int cols, int depth);
+// Returns 1 if the storage could not grow
+int grid_reset(Grid *grid, int rows, int cols, int depth, unsigned long int centre, unsigned long int allVal);
 void grid_free(Grid *grid);
+// Fills a grid sized by grid_resize as the block of a global_rows x
+// global_cols grid whose first cell is global (origin_row, origin_col): allVal
+// and the centre spike for the flat load, the base load of the other kinds,
+// the spikes that fall in the block, and zeroed ghost cells. In 3D the layers
+// are addressed as one depth * rows tall 2D grid and the block is the whole grid
+void grid_load_block(Grid *grid, const InitialCondition *init, unsigned long int centre, unsigned long int allVal,
+                     int origin_row, int origin_col, int global_rows, int global_cols);
+// Writes the interior cells as a grid file, returns 0 on success
+int grid_save(const Grid *grid, const char *filename);
 // For reading cell values from grid
 // int grid_get(const Grid *grid, int x, int y);
 // // For writing to grid
@@ -0,0 +1,72 @@
+// Initial configurations beyond "centre spike on a flat load": extra spikes,
+// random loads from a counter-based generator, and grids loaded from disk
+// guards prevent multiple inclusions
+#ifndef INITIAL_H
+#define INITIAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define GRID_FILE_MAGIC "SPG1"
+#define MAX_SPIKES 64
+
+// Binary grid file: this header followed by rows x cols uint32 cells in
+// row-major order. The header is 16 bytes so the cells can be mapped directly
+typedef struct GridFileHeader {
+    char magic[4];
+    int32_t rows, cols;
+    int32_t reserved;
+} GridFileHeader;
+
+typedef enum InitKind {
+    INIT_FLAT,    // Centre spike on allVal everywhere, the original setup
+    INIT_UNIFORM, // Each cell uniform in [0, max]
+    INIT_POISSON, // Each cell Poisson distributed with the given mean
+    INIT_FILE     // Cells read from a grid file
+} InitKind;
+
+typedef struct Spike {
+    int row, col; // 0-based global position
+    unsigned long int value;
+} Spike;
+
+typedef struct InitialCondition {
+    InitKind kind;
+    unsigned long int max; // INIT_UNIFORM
+    double mean;           // INIT_POISSON
+    uint64_t seed;
+    const char *file;      // INIT_FILE
+    // Mapping of file, set by initial_open
+    const uint32_t *cells;
+    int rows, cols;
+    size_t map_size;
+    // Added on top of the base load
+    Spike spikes[MAX_SPIKES];
+    int num_spikes;
+} InitialCondition;
+
+void initial_default(InitialCondition *init);
+// Parses "uniform:MAX[:SEED]", "poisson:MEAN[:SEED]" or "file:PATH", returns 0 on success
+int initial_parse(const char *spec, InitialCondition *init);
+// Parses "ROW,COL,VALUE", returns 0 on success
+int initial_add_spike(const char *spec, InitialCondition *init);
+// Maps the grid file for INIT_FILE, nothing for the other kinds. Pages are only
+// read when touched, so each process or thread only reads the cells it uses
+int initial_open(InitialCondition *init);
+void initial_close(InitialCondition *init);
+
+// Base load of global cell (row, col), 0-based. Every kind is a pure function
+// of the position, so any decomposition fills the grid identically
+unsigned long int initial_value(const InitialCondition *init, int row, int col, int cols);
+// Identifies the initial condition in checksum files, 0 for the flat load
+// without spikes so plain "rows cols centre allVal" runs keep one key
+uint64_t initial_fingerprint(const InitialCondition *init);
+
+// Writing a grid file from one or many processes: one process creates it at
+// full size, then each writes its own rows
+int grid_file_create(const char *filename, int rows, int cols);
+int grid_file_open(const char *filename);
+// Writes count cells starting at global (row, col)
+int grid_file_write(int fd, int cols, int row, int col, const uint32_t *values, int count);
+
+#endif
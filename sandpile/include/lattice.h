@@ -0,0 +1,100 @@
+// Lattice the sandpile lives on, fixed at compile time so every kernel is
+// generated with the neighbour adds unrolled and the threshold a constant.
+// Build with -DLATTICE_MOORE, -DLATTICE_HEX or -DLATTICE_CUBIC, the default
+// is the 4-neighbour square lattice.
+//
+//   square  4 neighbours, threshold 4, share v >> 2, keep v & 3
+//   Moore   8 neighbours, threshold 8, share v >> 3, keep v & 7
+//   hex     6 neighbours, threshold 6, axial coordinates on the square array:
+//           (i-1, j) (i-1, j+1) (i, j-1) (i, j+1) (i+1, j-1) (i+1, j)
+//   cubic   6 neighbours in 3D, threshold 6, z layers stacked as row blocks
+// guards prevent multiple inclusions
+#ifndef LATTICE_H
+#define LATTICE_H
+
+// Plain and atomic adds, the scatter macros take one of them
+#define PLAIN_ADD(x, d) ((x) += (d))
+#define ATOMIC_ADD(x, d) do { _Pragma("omp atomic") (x) += (d); } while (0)
+
+#if defined(LATTICE_MOORE)
+
+#define LATTICE_NAME "Moore"
+#define LATTICE_ID 1
+#define THRESHOLD 8
+#define LATTICE_SHARE(v) ((v) >> 3)
+#define LATTICE_KEEP(v) ((v) & 7)
+#define LATTICE_DIAGONAL 1
+#define LATTICE_3D 0
+// Columns reached in the rows above and below, relative to j
+#define LATTICE_UP_LO (-1)
+#define LATTICE_UP_HI 1
+#define LATTICE_DOWN_LO (-1)
+#define LATTICE_DOWN_HI 1
+#define LATTICE_ADD_UP(up, j, d, ADD) do { ADD((up)[(j) - 1], d); ADD((up)[j], d); ADD((up)[(j) + 1], d); } while (0)
+#define LATTICE_ADD_DOWN(down, j, d, ADD) do { ADD((down)[(j) - 1], d); ADD((down)[j], d); ADD((down)[(j) + 1], d); } while (0)
+
+#elif defined(LATTICE_HEX)
+
+#define LATTICE_NAME "Hex"
+#define LATTICE_ID 2
+#define THRESHOLD 6
+#define LATTICE_SHARE(v) ((v) / 6)
+#define LATTICE_KEEP(v) ((v) % 6)
+#define LATTICE_DIAGONAL 1
+#define LATTICE_3D 0
+#define LATTICE_UP_LO 0
+#define LATTICE_UP_HI 1
+#define LATTICE_DOWN_LO (-1)
+#define LATTICE_DOWN_HI 0
+#define LATTICE_ADD_UP(up, j, d, ADD) do { ADD((up)[j], d); ADD((up)[(j) + 1], d); } while (0)
+#define LATTICE_ADD_DOWN(down, j, d, ADD) do { ADD((down)[(j) - 1], d); ADD((down)[j], d); } while (0)
+
+#elif defined(LATTICE_CUBIC)
+
+#define LATTICE_NAME "Cubic"
+#define LATTICE_ID 3
+#define THRESHOLD 6
+#define LATTICE_SHARE(v) ((v) / 6)
+#define LATTICE_KEEP(v) ((v) % 6)
+#define LATTICE_DIAGONAL 0
+#define LATTICE_3D 1
+#define LATTICE_UP_LO 0
+#define LATTICE_UP_HI 0
+#define LATTICE_DOWN_LO 0
+#define LATTICE_DOWN_HI 0
+#define LATTICE_ADD_UP(up, j, d, ADD) ADD((up)[j], d)
+#define LATTICE_ADD_DOWN(down, j, d, ADD) ADD((down)[j], d)
+// Same column in the layers below and above
+#define LATTICE_ADD_Z(below, above, j, d, ADD) do { ADD((below)[j], d); ADD((above)[j], d); } while (0)
+
+#else
+
+#define LATTICE_SQUARE
+#define LATTICE_NAME ""
+#define LATTICE_ID 0
+#define THRESHOLD 4
+#define LATTICE_SHARE(v) ((v) >> 2)
+#define LATTICE_KEEP(v) ((v) & 3)
+#define LATTICE_DIAGONAL 0
+#define LATTICE_3D 0
+#define LATTICE_UP_LO 0
+#define LATTICE_UP_HI 0
+#define LATTICE_DOWN_LO 0
+#define LATTICE_DOWN_HI 0
+#define LATTICE_ADD_UP(up, j, d, ADD) ADD((up)[j], d)
+#define LATTICE_ADD_DOWN(down, j, d, ADD) ADD((down)[j], d)
+
+#endif
+
+// Left and right neighbours are the same on every lattice
+#define LATTICE_ADD_ROW(row, j, d, ADD) do { ADD((row)[(j) - 1], d); ADD((row)[(j) + 1], d); } while (0)
+
+// All in-plane neighbours of column j, up, row and down are the rows above,
+// of and below the cell
+#define LATTICE_SCATTER(up, row, down, j, d, ADD) do { \
+    LATTICE_ADD_UP(up, j, d, ADD);                    \
+    LATTICE_ADD_ROW(row, j, d, ADD);                  \
+    LATTICE_ADD_DOWN(down, j, d, ADD);                \
+} while (0)
+
+#endif
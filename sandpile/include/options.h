@@ -0,0 +1,57 @@
+// Command line options shared by the serial, OpenMP and MPI executables
+#include <stdbool.h>
+#include "initial.h"
+// guards prevent multiple inclusions
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#define DEFAULT_BLOCK_SIZE 64
+#define DEFAULT_TIME_STEPS 8
+#define DEFAULT_RESULTS_FILE "/mnt/lustre/users/student42/HPC_A1/results.csv"
+#define DEFAULT_CHECKSUMS_FILE "/mnt/lustre/users/student42/HPC_A1/checksums.csv"
+
+typedef struct SandpileOptions {
+    int rows;
+    int cols;
+    unsigned long int centre;
+    unsigned long int allVal;
+    int depth;       // Layers of the cubic lattice, 1 on the 2D lattices
+    bool blocked;    // Use the temporally blocked kernel
+    const char *engine; // Engine by name, NULL for the program's default
+    const char *simd;   // Cap the row kernel's SIMD level, NULL for the best
+    int block_size;  // Side length of a cache resident block
+    int time_steps;  // Sweeps applied to a block before moving on
+    bool wavefront;  // Wavefront engine: reproduce the serial sweep order exactly
+    const char *pass_log; // File for per pass topple counts, NULL for none
+    int frame_every;      // Capture a time-lapse frame every N passes, 0 for none
+    const char *frames_file;
+    bool frames_wait;     // Keep every frame, waiting for the writer when it falls behind
+    const char *pyramid_dir; // Write a tiled image pyramid here instead of one PPM
+    const char *batch_file;  // Run every configuration listed in this file
+    const char *results_file;
+    const char *checksums_file; // csv the final grid checksum of every run is appended to
+    InitialCondition init;   // Base load and extra spikes
+    const char *save_file;   // Write the final grid as a grid file, NULL for none
+    const char *progress_file; // Append live progress samples here, NULL for none
+    int progress_every;        // Seconds between progress samples
+} SandpileOptions;
+
+// One grid configuration of a run
+typedef struct RunConfig {
+    int rows;
+    int cols;
+    unsigned long int centre;
+    unsigned long int allVal;
+} RunConfig;
+
+void options_default(SandpileOptions *opts);
+// Parses "[rows cols centre allVal] [--flags]", returns 0 on success
+int parse_options(int argc, char *argv[], SandpileOptions *opts);
+void print_usage(const char *prog);
+// Configurations to run: the batch file's "rows cols centre allVal" lines, or
+// the single configuration from the command line. A grid file given with
+// --init sets rows and cols, so initial_open must come first. A --spike
+// outside any of the grids is an error. Returns the count, 0 on error
+int load_configs(const SandpileOptions *opts, RunConfig **configs);
+
+#endif
@@ -4,9 +4,14 @@
 #include "grid.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 
-void write_results(const char *filename, const char *version, int num_Threads, int rows, int cols, unsigned long int centre, unsigned long int allVal, double async_time);
+FILE* results_open(const char *filename);
+void results_append(FILE *file, const char *version, int num_Threads, int rows, int cols, unsigned long int centre, unsigned long int allVal, double async_time);
 void visualize_grid_as_image(Grid* grid, const char *filename);
-void gridWrite(FILE *file, int** sandpile, int i, int j, int value);
-void vis_grid(int** sandpile, const char *filename, int rows, int cols, bool mpi);
+void pyramid_from_grid(Grid *grid, const char *dir);
+// Levels below split of grid as block of a larger grid starting at global
+// (origin_row, origin_col), so every MPI rank writes only its own tiles.
+// Returns the colour counts of level split, see pyramid_write_block
+uint32_t* pyramid_from_block(Grid *grid, const char *dir, int block, int origin_row, int origin_col, int split);
 #endif
\ No newline at end of file
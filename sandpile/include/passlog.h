@@ -0,0 +1,18 @@
+// Per pass statistics used to compare engines pass by pass
+// guards prevent multiple inclusions
+#ifndef PASSLOG_H
+#define PASSLOG_H
+
+typedef struct PassLog {
+    long *topples;  // Number of cells toppled in each pass
+    int count;
+    int capacity;
+} PassLog;
+
+void passlog_init(PassLog *log);
+void passlog_add(PassLog *log, long topples);
+// Writes "pass,topples" lines, one per pass
+void passlog_write(const PassLog *log, const char *filename);
+void passlog_free(PassLog *log);
+
+#endif
@@ -0,0 +1,43 @@
+// Live progress of long runs: workers publish counters into their own slot,
+// a sidecar thread samples the slots every few seconds and appends a line
+// to a status file that can be followed with tail -f
+// guards prevent multiple inclusions
+#ifndef PROGRESS_H
+#define PROGRESS_H
+
+#include <stdatomic.h>
+
+#define PROGRESS_SLOT_BYTES 64 // One cache line per slot, workers never share one
+#define DEFAULT_PROGRESS_EVERY 5
+
+// Counters of one thread, band or rank. Each field has a single writer, so
+// updates are relaxed loads and stores without locks or read-modify-writes
+typedef struct ProgressSlot {
+    _Alignas(PROGRESS_SLOT_BYTES) atomic_long pass; // Passes completed, 0 if the slot does not count them
+    atomic_long topples;  // Cells toppled since the start
+    // Cells found above threshold in the last pass, each counted once even by
+    // kernels that sweep a tile or block several times in a pass
+    atomic_long unstable;
+    atomic_long active;   // Cells swept in the last pass
+} ProgressSlot;
+
+typedef struct ProgressMonitor ProgressMonitor;
+
+static inline void progress_set(atomic_long *field, long value) {
+    atomic_store_explicit(field, value, memory_order_relaxed);
+}
+
+// Only for the slot's own writer
+static inline void progress_add(atomic_long *field, long delta) {
+    atomic_store_explicit(field, atomic_load_explicit(field, memory_order_relaxed) + delta, memory_order_relaxed);
+}
+
+// Starts the sidecar thread appending to filename every interval seconds,
+// returns NULL on failure. version, rows and cols go in the run's header line
+ProgressMonitor* progress_start(const char *filename, int num_slots, int interval, const char *version,
+                                int rows, int cols);
+ProgressSlot* progress_slot(ProgressMonitor *monitor, int slot);
+// Writes a last sample and stops the thread, NULL is ignored
+void progress_stop(ProgressMonitor *monitor);
+
+#endif
@@ -0,0 +1,32 @@
+// Multi-resolution tiled image output for grids too large for one PPM
+// guards prevent multiple inclusions
+#ifndef PYRAMID_H
+#define PYRAMID_H
+
+#include <stdint.h>
+
+#define PYRAMID_TILE 256
+
+// Writes the block of rows x cols cells with colour indices 0..3 as a tiled
+// image pyramid into dir. Level 0 is full resolution, every further level
+// halves both sides and colours each pixel with the most common colour of the
+// cells it covers, until a level fits in one tile. Tiles are binary PPMs named
+// b<block>_L<level>_<tile_row>_<tile_col>.ppm and index_<block>.txt records
+// where the block sits in the global grid and which levels it holds.
+void pyramid_write(const char *dir, int block, int origin_row, int origin_col,
+                   int rows, int cols, const unsigned char *colours);
+
+// Split pyramids for grids spread over several processes. A coarse pixel is
+// only exact if all the cells it covers are in one block, so the blocks must
+// start at multiples of 2^split cells. Each block writes its levels 0 to
+// split - 1 and returns the colour counts of its level split
+// (PYRAMID_COLOURS per pixel, NULL on failure, free after use), the counts of
+// all blocks are summed into the global level split and
+// pyramid_write_counts writes it and the levels above as one block of the
+// rows x cols grid. Takes ownership of counts.
+#define PYRAMID_COLOURS 5
+uint32_t* pyramid_write_block(const char *dir, int block, int origin_row, int origin_col,
+                              int rows, int cols, const unsigned char *colours, int split);
+void pyramid_write_counts(const char *dir, int block, int split, int rows, int cols, uint32_t *counts);
+
+#endif
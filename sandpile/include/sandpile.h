@@ -1,12 +1,28 @@
 #include "../include/grid.h"
+#include "../include/passlog.h"
+#include "../include/frames.h"
+#include "../include/progress.h"
+#include "../include/simd.h"
 
 #ifndef SANDPILE_H 
 #define SANDPILE_H
 
-void async_new_tile(int x, int y, Grid *grid);
-void topple_asynch(Grid *grid);
+int async_new_tile(int x, int y, Grid *grid); // Returns 1 if the cell toppled
+// The kernels return the number of passes, the last one finds the grid stable,
+// or -1 when their buffers cannot be allocated
+int topple_asynch(Grid *grid);
+int topple_blocked(Grid *grid, int block_size, int time_steps);
+// Synchronous passes with the row kernel of level, which must be available
+int topple_synch(Grid *grid, SimdLevel level);
+// Monotonic wall clock in seconds, every kernel is timed with it
+double wall_time(void);
 
 extern double time_async; // Asynchronous time
 extern double time_sync; // Synchronous time
+extern long run_topples; // Topples of the last run of any kernel
+extern PassLog *pass_log; // Topples per pass of every kernel, NULL to skip
+extern FrameWriter *frame_writer; // Time-lapse output, NULL to skip
+extern int frame_every; // Passes between captured frames
+extern ProgressSlot *progress; // Live progress counters, NULL to skip
 
 #endif
\ No newline at end of file
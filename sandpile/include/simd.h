@@ -0,0 +1,30 @@
+// CPU feature detection and the row kernels of the synchronous engine, one
+// per instruction set, picked at run time
+// guards prevent multiple inclusions
+#ifndef SIMD_H
+#define SIMD_H
+
+typedef enum SimdLevel {
+    SIMD_SCALAR,
+    SIMD_AVX2,   // 4 cells per instruction
+    SIMD_AVX512, // 8 cells per instruction
+    NUM_SIMD_LEVELS
+} SimdLevel;
+
+// One row of a synchronous pass: out[j] = what row[j] keeps plus the shares
+// of its neighbours in up, row, down (and below, above in 3D) for j in 1 to
+// cols. Returns the number of cells of row at or above the threshold
+typedef long (*SynchRowKernel)(const unsigned long int *up, const unsigned long int *row,
+                               const unsigned long int *down, const unsigned long int *below,
+                               const unsigned long int *above, unsigned long int *out, int cols);
+
+// Best level both the CPU and the lattice support, the vector kernels need
+// the shift and mask of the square and Moore lattices
+SimdLevel simd_detect(void);
+const char* simd_name(SimdLevel level);
+// Parses "scalar", "avx2" or "avx512", returns 0 on success
+int simd_parse(const char *name, SimdLevel *level);
+// Kernel for level, NULL if this CPU or lattice cannot run it
+SynchRowKernel synch_row_kernel(SimdLevel level);
+
+#endif
@@ -0,0 +1,26 @@
+// OpenMP engines: red-black tiles, optionally temporally blocked, and a
+// row-band wavefront that keeps the serial sweep order. 2D lattices only
+#include "grid.h"
+#include "engine.h"
+// guards prevent multiple inclusions
+#ifndef TILED_H
+#define TILED_H
+
+#define TILE_SIZE 16 // Fixed optimal size for most cases
+
+// Topple a tile of tile_size x tile_size cells until it is stable, returns
+// the number of topples. Unless NULL, sweeps is set to the passes over the
+// tile including the stable one and unstable to the cells toppled by the
+// first, each of them once
+long process_tile(Grid *grid, int tile_row, int tile_col, int tile_size, int *sweeps, long *unstable);
+// Temporal blocking: advance a block of tiles_per_block x tiles_per_block
+// tiles for up to time_steps rounds while it is cache resident. Returns the
+// number of topples, unstable gets the cells toppled by the first sweep of
+// each tile in the first round
+long process_block(Grid *grid, int block_row, int block_col, int tile_size, int tiles_per_block, int time_steps,
+                   long *unstable);
+
+extern const Engine openmp_engine;
+extern const Engine wavefront_engine;
+
+#endif
@@ -0,0 +1,92 @@
+// Parallel grid checksums and the checksum csv
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "../include/checksum.h"
+
+void checksum_clear(GridChecksum *sum) {
+    memset(sum, 0, sizeof(GridChecksum));
+}
+
+void checksum_merge(GridChecksum *into, const GridChecksum *from) {
+    into->hash += from->hash;
+    into->grains += from->grains;
+    for (int b = 0; b < CHECKSUM_BINS; b++) {
+        into->histogram[b] += from->histogram[b];
+    }
+}
+
+int checksum_equal(const GridChecksum *a, const GridChecksum *b) {
+    return memcmp(a, b, sizeof(GridChecksum)) == 0;
+}
+
+// Covers every layer in 3D, indexed as one depth * global_rows tall grid
+void checksum_from_block(Grid *grid, int origin_row, int origin_col, int global_rows, int global_cols,
+                         GridChecksum *sum) {
+    int rows = grid->rows;
+    int cols = grid->cols;
+    int tall_rows = rows * grid->depth;
+    uint64_t hash = 0, grains = 0;
+    uint64_t histogram[CHECKSUM_BINS] = {0};
+
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(static) reduction(+:hash, grains, histogram[:CHECKSUM_BINS])
+#endif
+    for (int t = 0; t < tall_rows; t++) {
+        int z = GRID_FIRST_LAYER + t / rows;
+        int i = t % rows + 1;
+        unsigned long int *row = grid->layers[(size_t)z * grid->layer_stride + i];
+        uint64_t row_index = ((uint64_t)(z - GRID_FIRST_LAYER) * global_rows + origin_row + i - 1) * global_cols
+                             + origin_col - 1;
+        for (int j = 1; j <= cols; j++) {
+            unsigned long int value = row[j];
+            hash += checksum_cell(row_index + j, value);
+            grains += value;
+            histogram[value < CHECKSUM_BINS - 1 ? value : CHECKSUM_BINS - 1]++;
+        }
+    }
+
+    sum->hash = hash;
+    sum->grains = grains;
+    memcpy(sum->histogram, histogram, sizeof(histogram));
+}
+
+void checksum_print(const GridChecksum *sum) {
+    printf("Checksum %016" PRIx64 ", grains %" PRIu64 ", cells by value", sum->hash, sum->grains);
+    for (int b = 0; b < CHECKSUM_BINS; b++) {
+        printf(" %" PRIu64, sum->histogram[b]);
+    }
+    printf("\n");
+}
+
+void checksums_append(FILE *file, const char *version, int threads, int rows, int cols,
+                      unsigned long int centre, unsigned long int allVal, uint64_t init,
+                      const GridChecksum *sum) {
+    if (!file) return;
+    fprintf(file, "%s,%d,%d,%d,%lu,%lu,%016" PRIx64 ",%016" PRIx64 ",%" PRIu64,
+            version, threads, rows, cols, centre, allVal, init, sum->hash, sum->grains);
+    for (int b = 0; b < CHECKSUM_BINS; b++) {
+        fprintf(file, ",%" PRIu64, sum->histogram[b]);
+    }
+    fprintf(file, "\n");
+    fflush(file);
+}
+
+int checksums_parse(const char *line, char *version, size_t version_size, int *threads, int *rows,
+                    int *cols, unsigned long int *centre, unsigned long int *allVal, uint64_t *init,
+                    GridChecksum *sum) {
+    const char *comma = strchr(line, ',');
+    if (comma == NULL || version_size == 0) return 1;
+    size_t length = (size_t)(comma - line) < version_size - 1 ? (size_t)(comma - line) : version_size - 1;
+    memcpy(version, line, length);
+    version[length] = '\0';
+
+    int fields = sscanf(comma + 1, "%d,%d,%d,%lu,%lu,%" SCNx64 ",%" SCNx64 ",%" SCNu64
+                        ",%" SCNu64 ",%" SCNu64 ",%" SCNu64 ",%" SCNu64 ",%" SCNu64,
+                        threads, rows, cols, centre, allVal, init, &sum->hash, &sum->grains,
+                        &sum->histogram[0], &sum->histogram[1], &sum->histogram[2],
+                        &sum->histogram[3], &sum->histogram[4]);
+    return fields != 8 + CHECKSUM_BINS;
+}
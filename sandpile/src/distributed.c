@@ -0,0 +1,622 @@
+// MPI engine on the shared Grid, one block per rank
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <mpi.h>
+#include <omp.h>
+#include "../include/distributed.h"
+#include "../include/sandpile.h"
+#include "../include/out.h"
+#include "../include/pyramid.h"
+#include "../include/lattice.h"
+
+#if !LATTICE_3D
+
+// Process grid, created once per job, and the block of the current configuration
+typedef struct Distributed {
+    int north_rank, south_rank, east_rank, west_rank;
+    int nw_rank, ne_rank, sw_rank, se_rank; // Only exchanged with on lattices with diagonals
+    int proc_row, proc_col, proc_rows, proc_cols;
+    // Blocks start at multiples of this many cells, see pyramid_split
+    int unit;
+    int split;
+    // Box of cells that may be unstable, see local_sandpile_iteration
+    Box box;
+    MPI_Comm cart_comm;
+} Distributed;
+
+// Setup 2D Cartesian topology, done once and kept for every configuration
+static void setup_process_grid(Distributed *dist, int rank, int size) {
+    // Create 2D processor grid
+    int dims[2] = {0, 0};
+    MPI_Dims_create(size, 2, dims);
+    dist->proc_rows = dims[0];
+    dist->proc_cols = dims[1];
+
+    int periods[2] = {0, 0}; // No periodic boundaries
+    MPI_Cart_create(MPI_COMM_WORLD, 2, dims, periods, 1, &dist->cart_comm);
+
+    int coords[2];
+    MPI_Cart_coords(dist->cart_comm, rank, 2, coords);
+    dist->proc_row = coords[0];
+    dist->proc_col = coords[1];
+
+    // Find neighbor ranks
+    MPI_Cart_shift(dist->cart_comm, 0, 1, &dist->north_rank, &dist->south_rank);
+    MPI_Cart_shift(dist->cart_comm, 1, 1, &dist->west_rank, &dist->east_rank);
+
+    // Diagonal neighbours, MPI_Cart_shift only moves along one dimension
+    int *diagonal[4] = {&dist->nw_rank, &dist->ne_rank, &dist->sw_rank, &dist->se_rank};
+    for (int d = 0; d < 4; d++) {
+        int neighbour[2] = {coords[0] + (d < 2 ? -1 : 1), coords[1] + (d % 2 ? 1 : -1)};
+        if (neighbour[0] < 0 || neighbour[0] >= dims[0] || neighbour[1] < 0 || neighbour[1] >= dims[1]) {
+            *diagonal[d] = MPI_PROC_NULL;
+        } else {
+            MPI_Cart_rank(dist->cart_comm, neighbour, diagonal[d]);
+        }
+    }
+}
+
+// Start and size of block index of parts along a side of global cells. The
+// side is cut into units of unit cells and the first blocks get one unit
+// more when they do not divide evenly, only the last block ends mid unit
+static void block_extent(int global, int parts, int index, int unit, int *start, int *size) {
+    int units = (global + unit - 1) / unit;
+    int base = units / parts;
+    int extra = units % parts;
+    int first = index < extra ? index * (base + 1) : extra * (base + 1) + (index - extra) * base;
+    int count = index < extra ? base + 1 : base;
+    *start = first * unit;
+    *size = (first + count) * unit > global ? global - *start : count * unit;
+}
+
+// Level from which the pyramid is written by rank 0 instead of per block. A
+// coarse pixel is only right when one block holds all the cells under it, so
+// the blocks are aligned to 2^split cells, and the global colour counts of the
+// split level are summed onto rank 0. The split is the first level whose
+// counts (PYRAMID_COLOURS words a pixel) are no larger than one block, less if
+// the grid is too small to give every process a whole unit
+static int pyramid_split(const EngineRun *run, const Distributed *dist) {
+    int split = 0;
+    while ((1L << (2 * split)) < (long)PYRAMID_COLOURS * run->ranks) split++;
+    while (split > 0 && (((run->global_rows - 1) >> split) + 1 < dist->proc_rows ||
+                         ((run->global_cols - 1) >> split) + 1 < dist->proc_cols)) {
+        split--;
+    }
+    return split;
+}
+
+// Only the main thread calls MPI, the frame writer and progress threads do plain I/O
+static int mpi_open(EngineRun *run) {
+    int provided;
+    MPI_Init_thread(NULL, NULL, MPI_THREAD_FUNNELED, &provided);
+    MPI_Comm_rank(MPI_COMM_WORLD, &run->rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &run->ranks);
+
+    Distributed *dist = (Distributed*)calloc(1, sizeof(Distributed));
+    int failed = dist == NULL;
+    MPI_Allreduce(MPI_IN_PLACE, &failed, 1, MPI_INT, MPI_LOR, MPI_COMM_WORLD);
+    if (failed) {
+        free(dist);
+        MPI_Finalize();
+        return 1;
+    }
+    setup_process_grid(dist, run->rank, run->ranks);
+    run->state = dist;
+    // Ranks sweep their blocks on one thread, the OpenMP loops of the shared
+    // loading and output code would otherwise start a full team on every rank
+    if (getenv("OMP_NUM_THREADS") == NULL) omp_set_num_threads(1);
+    return 0;
+}
+
+static void mpi_close(EngineRun *run) {
+    Distributed *dist = (Distributed*)run->state;
+    MPI_Comm_free(&dist->cart_comm);
+    free(dist);
+    run->state = NULL;
+    MPI_Finalize();
+}
+
+// Domain decomposition of the configuration over the process grid, each rank
+// fills only its own block. A failure on any rank fails every rank
+static int mpi_init(EngineRun *run, const RunConfig *config) {
+    Distributed *dist = (Distributed*)run->state;
+    // Only the pyramid needs aligned blocks
+    dist->split = !run->batch && run->opts->pyramid_dir ? pyramid_split(run, dist) : 0;
+    dist->unit = 1 << dist->split;
+    int rows, cols;
+    block_extent(run->global_rows, dist->proc_rows, dist->proc_row, dist->unit, &run->origin_row, &rows);
+    block_extent(run->global_cols, dist->proc_cols, dist->proc_col, dist->unit, &run->origin_col, &cols);
+
+    if (run->rank == 0) {
+        printf("Running MPI sandpile simulation on %d processes\n", run->ranks);
+        printf("Global grid: %dx%d\n", run->global_rows, run->global_cols);
+        printf("Process grid: %dx%d\n", dist->proc_rows, dist->proc_cols);
+    }
+
+    int failed = engine_load(run, config, rows, cols);
+    MPI_Allreduce(MPI_IN_PLACE, &failed, 1, MPI_INT, MPI_LOR, MPI_COMM_WORLD);
+    // Every interior cell may be unstable at the start, an empty block has none
+    dist->box = rows > 0 && cols > 0 ? (Box){1, rows, 1, cols} : (Box){1, 0, 1, 0};
+    return failed;
+}
+
+// Set the active box from the cells toppled in a local pass
+static void set_box_from_toppled(Box *box, int top, int bottom, int left, int right) {
+    if (top > bottom) {
+        box->top = 1;
+        box->bottom = 0;
+        return;
+    }
+    box->top = top - 1;
+    box->bottom = bottom + 1;
+    box->left = left - 1;
+    box->right = right + 1;
+}
+
+// Grow the active box to cover one cell
+static void include_in_box(Box *box, int i, int j) {
+    if (box->top > box->bottom) {
+        box->top = box->bottom = i;
+        box->left = box->right = j;
+        return;
+    }
+    if (i < box->top) box->top = i;
+    if (i > box->bottom) box->bottom = i;
+    if (j < box->left) box->left = j;
+    if (j > box->right) box->right = j;
+}
+
+// Collect boundary contributions that went to ghost cells and send them back to neighbors.
+// A ghost row or column is only sent when the active box reaches it, otherwise an
+// empty message tells the neighbour there is nothing to add.
+static void collect_boundary_contributions(Distributed *dist, Grid *grid) {
+    unsigned long int **s = grid->sandpile;
+    int rows = grid->rows;
+    int cols = grid->cols;
+    Box *box = &dist->box;
+    MPI_Request requests[16];
+    MPI_Status statuses[16];
+    int req_count = 0;
+    int north_req = -1, south_req = -1, west_req = -1, east_req = -1;
+
+    // Which ghost cells can hold grains, taken from the active box
+    int active = box->top <= box->bottom;
+    int row_lo = box->top < 1 ? 1 : box->top;
+    int row_hi = box->bottom > rows ? rows : box->bottom;
+    int col_lo = box->left < 1 ? 1 : box->left;
+    int col_hi = box->right > cols ? cols : box->right;
+    int north_count = (active && box->top == 0) ? cols : 0;
+    int south_count = (active && box->bottom == rows + 1) ? cols : 0;
+    int west_count = (active && box->left == 0) ? rows : 0;
+    int east_count = (active && box->right == cols + 1) ? rows : 0;
+
+    // Allocate buffers for contributions from ghost cells
+    unsigned long int *north_contrib = (unsigned long int*)calloc(cols, sizeof(unsigned long int));
+    unsigned long int *south_contrib = (unsigned long int*)calloc(cols, sizeof(unsigned long int));
+    unsigned long int *west_contrib = (unsigned long int*)calloc(rows, sizeof(unsigned long int));
+    unsigned long int *east_contrib = (unsigned long int*)calloc(rows, sizeof(unsigned long int));
+
+    unsigned long int *north_recv = (unsigned long int*)calloc(cols, sizeof(unsigned long int));
+    unsigned long int *south_recv = (unsigned long int*)calloc(cols, sizeof(unsigned long int));
+    unsigned long int *west_recv = (unsigned long int*)calloc(rows, sizeof(unsigned long int));
+    unsigned long int *east_recv = (unsigned long int*)calloc(rows, sizeof(unsigned long int));
+
+    // Collect contributions from ghost cells
+    if (dist->north_rank != MPI_PROC_NULL) {
+        for (int j = col_lo - 1; north_count && j < col_hi; j++) {
+            north_contrib[j] = s[0][j + 1];
+            s[0][j + 1] = 0; // Clear ghost cell
+        }
+        MPI_Isend(north_contrib, north_count, MPI_UNSIGNED_LONG, dist->north_rank, 4, MPI_COMM_WORLD, &requests[req_count++]);
+        north_req = req_count;
+        MPI_Irecv(north_recv, cols, MPI_UNSIGNED_LONG, dist->north_rank, 5, MPI_COMM_WORLD, &requests[req_count++]);
+    }
+
+    if (dist->south_rank != MPI_PROC_NULL) {
+        for (int j = col_lo - 1; south_count && j < col_hi; j++) {
+            south_contrib[j] = s[rows + 1][j + 1];
+            s[rows + 1][j + 1] = 0; // Clear ghost cell
+        }
+        MPI_Isend(south_contrib, south_count, MPI_UNSIGNED_LONG, dist->south_rank, 5, MPI_COMM_WORLD, &requests[req_count++]);
+        south_req = req_count;
+        MPI_Irecv(south_recv, cols, MPI_UNSIGNED_LONG, dist->south_rank, 4, MPI_COMM_WORLD, &requests[req_count++]);
+    }
+
+    if (dist->west_rank != MPI_PROC_NULL) {
+        for (int i = row_lo - 1; west_count && i < row_hi; i++) {
+            west_contrib[i] = s[i + 1][0];
+            s[i + 1][0] = 0; // Clear ghost cell
+        }
+        MPI_Isend(west_contrib, west_count, MPI_UNSIGNED_LONG, dist->west_rank, 6, MPI_COMM_WORLD, &requests[req_count++]);
+        west_req = req_count;
+        MPI_Irecv(west_recv, rows, MPI_UNSIGNED_LONG, dist->west_rank, 7, MPI_COMM_WORLD, &requests[req_count++]);
+    }
+
+    if (dist->east_rank != MPI_PROC_NULL) {
+        for (int i = row_lo - 1; east_count && i < row_hi; i++) {
+            east_contrib[i] = s[i + 1][cols + 1];
+            s[i + 1][cols + 1] = 0; // Clear ghost cell
+        }
+        MPI_Isend(east_contrib, east_count, MPI_UNSIGNED_LONG, dist->east_rank, 7, MPI_COMM_WORLD, &requests[req_count++]);
+        east_req = req_count;
+        MPI_Irecv(east_recv, rows, MPI_UNSIGNED_LONG, dist->east_rank, 6, MPI_COMM_WORLD, &requests[req_count++]);
+    }
+
+#if LATTICE_DIAGONAL
+    // Ghost corners belong to the diagonal neighbours, in order NW, NE, SW, SE.
+    // Corner c is received from the neighbour's opposite corner 3 - c
+    int corner_rank[4] = {dist->nw_rank, dist->ne_rank, dist->sw_rank, dist->se_rank};
+    unsigned long int corner_contrib[4] = {0, 0, 0, 0}, corner_recv[4] = {0, 0, 0, 0};
+    int corner_req[4] = {-1, -1, -1, -1};
+    for (int c = 0; c < 4; c++) {
+        if (corner_rank[c] == MPI_PROC_NULL) continue;
+        int i = c < 2 ? 0 : rows + 1;
+        int j = c % 2 ? cols + 1 : 0;
+        int corner_count = active && box->top <= i && i <= box->bottom && box->left <= j && j <= box->right;
+        if (corner_count) {
+            corner_contrib[c] = s[i][j];
+            s[i][j] = 0; // Clear ghost cell
+        }
+        MPI_Isend(&corner_contrib[c], corner_count, MPI_UNSIGNED_LONG, corner_rank[c], 8 + c, MPI_COMM_WORLD, &requests[req_count++]);
+        corner_req[c] = req_count;
+        MPI_Irecv(&corner_recv[c], 1, MPI_UNSIGNED_LONG, corner_rank[c], 11 - c, MPI_COMM_WORLD, &requests[req_count++]);
+    }
+#endif
+
+    // Wait for all communications to complete
+    MPI_Waitall(req_count, requests, statuses);
+
+    // A block left empty by more processes than rows or columns lies past the
+    // edge of the grid, grains sent to it fall off like at any other edge.
+    // Adding them would put ghost cells in the box
+    if (rows == 0 || cols == 0) {
+        north_req = south_req = west_req = east_req = -1;
+#if LATTICE_DIAGONAL
+        for (int c = 0; c < 4; c++) corner_req[c] = -1;
+#endif
+    }
+
+    // The box now only needs to cover interior cells
+    if (active) {
+        box->top = row_lo;
+        box->bottom = row_hi;
+        box->left = col_lo;
+        box->right = col_hi;
+    }
+
+    // Add received contributions to boundary cells, empty messages carry nothing
+    int count = 0;
+    if (north_req >= 0) {
+        MPI_Get_count(&statuses[north_req], MPI_UNSIGNED_LONG, &count);
+        for (int j = 0; j < count; j++) {
+            if (north_recv[j]) {
+                s[1][j + 1] += north_recv[j]; // Add to first internal row
+                include_in_box(box, 1, j + 1);
+            }
+        }
+    }
+
+    if (south_req >= 0) {
+        MPI_Get_count(&statuses[south_req], MPI_UNSIGNED_LONG, &count);
+        for (int j = 0; j < count; j++) {
+            if (south_recv[j]) {
+                s[rows][j + 1] += south_recv[j]; // Add to last internal row
+                include_in_box(box, rows, j + 1);
+            }
+        }
+    }
+
+    if (west_req >= 0) {
+        MPI_Get_count(&statuses[west_req], MPI_UNSIGNED_LONG, &count);
+        for (int i = 0; i < count; i++) {
+            if (west_recv[i]) {
+                s[i + 1][1] += west_recv[i]; // Add to first internal column
+                include_in_box(box, i + 1, 1);
+            }
+        }
+    }
+
+    if (east_req >= 0) {
+        MPI_Get_count(&statuses[east_req], MPI_UNSIGNED_LONG, &count);
+        for (int i = 0; i < count; i++) {
+            if (east_recv[i]) {
+                s[i + 1][cols] += east_recv[i]; // Add to last internal column
+                include_in_box(box, i + 1, cols);
+            }
+        }
+    }
+
+#if LATTICE_DIAGONAL
+    for (int c = 0; c < 4; c++) {
+        if (corner_req[c] < 0) continue;
+        MPI_Get_count(&statuses[corner_req[c]], MPI_UNSIGNED_LONG, &count);
+        if (count && corner_recv[c]) {
+            int i = c < 2 ? 1 : rows;
+            int j = c % 2 ? cols : 1;
+            s[i][j] += corner_recv[c]; // Add to the corner cell
+            include_in_box(box, i, j);
+        }
+    }
+#endif
+
+    // Free buffers
+    free(north_contrib); free(south_contrib); free(north_recv); free(south_recv);
+    free(west_contrib); free(east_contrib); free(west_recv); free(east_recv);
+}
+
+// Process ALL unstable cells of the box in one sweep, a rank whose box is
+// empty does no work
+long local_sandpile_iteration(Grid *grid, Box *box) {
+    unsigned long int **s = grid->sandpile;
+    long changed = 0;
+    int top = grid->rows + 1, bottom = 0;
+    int left = grid->cols + 1, right = 0;
+
+    for (int i = box->top; i <= box->bottom; i++) {
+        for (int j = box->left; j <= box->right; j++) {
+            if (s[i][j] >= THRESHOLD) {
+                unsigned long int dist = LATTICE_SHARE(s[i][j]);
+                s[i][j] = LATTICE_KEEP(s[i][j]);
+
+                // Distribute to neighbors (including ghost cells)
+                LATTICE_SCATTER(s[i-1], s[i], s[i+1], j, dist, PLAIN_ADD);
+                changed++;
+
+                if (i < top) top = i;
+                bottom = i;
+                if (j < left) left = j;
+                if (j > right) right = j;
+            }
+        }
+    }
+
+    set_box_from_toppled(box, top, bottom, left, right);
+    return changed;
+}
+
+// Ghost cells are never toppled, they only accumulate, so several sweeps can
+// run between halo exchanges and collect_boundary_contributions still
+// forwards every grain. The first sweep of each block counts every unstable
+// cell once.
+long local_sandpile_blocked(Grid *grid, Box *box, int block_size, int time_steps, long *unstable) {
+    unsigned long int **s = grid->sandpile;
+    long changed = 0;
+    *unstable = 0;
+    int top = grid->rows + 1, bottom = 0;
+    int left = grid->cols + 1, right = 0;
+
+    for (int bi = box->top; bi <= box->bottom; bi += block_size) {
+        int end_i = bi + block_size > box->bottom + 1 ? box->bottom + 1 : bi + block_size;
+        for (int bj = box->left; bj <= box->right; bj += block_size) {
+            int end_j = bj + block_size > box->right + 1 ? box->right + 1 : bj + block_size;
+
+            for (int t = 0; t < time_steps; t++) {
+                long block_changed = 0;
+                for (int i = bi; i < end_i; i++) {
+                    for (int j = bj; j < end_j; j++) {
+                        if (s[i][j] >= THRESHOLD) {
+                            unsigned long int dist = LATTICE_SHARE(s[i][j]);
+                            s[i][j] = LATTICE_KEEP(s[i][j]);
+                            LATTICE_SCATTER(s[i-1], s[i], s[i+1], j, dist, PLAIN_ADD);
+                            block_changed++;
+
+                            if (i < top) top = i;
+                            if (i > bottom) bottom = i;
+                            if (j < left) left = j;
+                            if (j > right) right = j;
+                        }
+                    }
+                }
+                if (!block_changed) break;
+                if (t == 0) *unstable += block_changed;
+                changed += block_changed;
+            }
+        }
+    }
+
+    set_box_from_toppled(box, top, bottom, left, right);
+    return changed;
+}
+
+// Local passes and halo exchanges until no rank topples. The stats are this
+// rank's until mpi_stats combines them
+static int mpi_stabilize(EngineRun *run, EngineStats *stats) {
+    Distributed *dist = (Distributed*)run->state;
+    const SandpileOptions *opts = run->opts;
+    Grid *grid = run->grid;
+    ProgressSlot *slot = progress_slot(run->progress, 0);
+    int iteration = 0;
+    int global_changed = 1;
+    long total = 0;
+
+    double start = wall_time();
+    while (global_changed) {
+        iteration++;
+        if (slot) {
+            Box *box = &dist->box;
+            long active = box->top > box->bottom ? 0 :
+                (long)(box->bottom - box->top + 1) * (box->right - box->left + 1);
+            progress_set(&slot->active, active);
+        }
+
+        // Perform local sandpile iteration (may update ghost cells)
+        long unstable;
+        long topples = opts->blocked
+            ? local_sandpile_blocked(grid, &dist->box, opts->block_size, opts->time_steps, &unstable)
+            : (unstable = local_sandpile_iteration(grid, &dist->box));
+        int local_changed = topples != 0;
+        total += topples;
+        if (slot) {
+            progress_add(&slot->topples, topples);
+            progress_set(&slot->unstable, unstable);
+            progress_set(&slot->pass, iteration);
+        }
+
+        // Collect contributions from ghost cells and send back to neighbors
+        collect_boundary_contributions(dist, grid);
+
+        // Check if any process had changes
+        MPI_Allreduce(&local_changed, &global_changed, 1, MPI_INT, MPI_LOR, MPI_COMM_WORLD);
+
+        frames_capture(run->frames, run->grid, run->opts->frame_every, iteration, !global_changed);
+    }
+    stats->seconds = wall_time() - start;
+    stats->passes = iteration;
+    stats->topples = total;
+    stats->threads = run->ranks;
+    if (run->rank == 0) {
+        printf("Sandpile stabilized after %d iterations\n", iteration - 1);
+    }
+    return 0;
+}
+
+// Topples add up over the blocks, the run lasts as long as its slowest rank
+static void mpi_stats(EngineRun *run, EngineStats *stats) {
+    MPI_Allreduce(MPI_IN_PLACE, &stats->topples, 1, MPI_LONG, MPI_SUM, MPI_COMM_WORLD);
+    MPI_Allreduce(MPI_IN_PLACE, &stats->seconds, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+}
+
+// Every field of the checksum is a sum, so the per rank partials are
+// combined with one reduction and the grid is never gathered
+static void mpi_checksum(EngineRun *run, GridChecksum *sum) {
+    GridChecksum local;
+    checksum_from_block(run->grid, run->origin_row, run->origin_col, run->global_rows, run->global_cols, &local);
+    MPI_Reduce(&local, sum, CHECKSUM_WORDS, MPI_UINT64_T, MPI_SUM, 0, MPI_COMM_WORLD);
+}
+
+// Gathers the blocks into a whole grid on rank 0 for the PPM
+static void mpi_image(EngineRun *run, const char *filename) {
+    Distributed *dist = (Distributed*)run->state;
+    Grid *grid = run->grid;
+    int *recvcounts = NULL;
+    int *displs = NULL;
+    unsigned long int *gathered = NULL;
+    Grid *whole = NULL;
+
+    if (run->rank == 0) {
+        recvcounts = (int*)malloc(run->ranks * sizeof(int));
+        displs = (int*)malloc(run->ranks * sizeof(int));
+        gathered = (unsigned long int*)malloc((size_t)run->global_rows * run->global_cols * sizeof(unsigned long int));
+        whole = grid_create(run->global_rows, run->global_cols, 1, 0, 0);
+
+        // Calculate receive counts and displacements for each process
+        for (int p = 0; p < run->ranks; p++) {
+            int p_start_row, p_start_col, p_rows, p_cols;
+            block_extent(run->global_rows, dist->proc_rows, p / dist->proc_cols, dist->unit, &p_start_row, &p_rows);
+            block_extent(run->global_cols, dist->proc_cols, p % dist->proc_cols, dist->unit, &p_start_col, &p_cols);
+            recvcounts[p] = p_rows * p_cols;
+            displs[p] = (p == 0) ? 0 : displs[p-1] + recvcounts[p-1];
+        }
+    }
+
+    // Pack local interior data
+    int local_size = grid->rows * grid->cols;
+    unsigned long int *local = (unsigned long int*)malloc(local_size * sizeof(unsigned long int));
+    for (int i = 0; i < grid->rows; i++) {
+        memcpy(local + (size_t)i * grid->cols, grid->sandpile[i + 1] + 1, grid->cols * sizeof(unsigned long int));
+    }
+
+    MPI_Gatherv(local, local_size, MPI_UNSIGNED_LONG, gathered, recvcounts, displs, MPI_UNSIGNED_LONG, 0,
+                MPI_COMM_WORLD);
+
+    if (run->rank == 0 && whole) {
+        // Place the block of every process in the global grid
+        for (int p = 0; p < run->ranks; p++) {
+            int p_start_row, p_start_col, p_rows, p_cols;
+            block_extent(run->global_rows, dist->proc_rows, p / dist->proc_cols, dist->unit, &p_start_row, &p_rows);
+            block_extent(run->global_cols, dist->proc_cols, p % dist->proc_cols, dist->unit, &p_start_col, &p_cols);
+            for (int i = 0; i < p_rows; i++) {
+                memcpy(whole->sandpile[p_start_row + i + 1] + p_start_col + 1,
+                       gathered + displs[p] + (size_t)i * p_cols, p_cols * sizeof(unsigned long int));
+            }
+        }
+        visualize_grid_as_image(whole, filename);
+    }
+    grid_free(whole);
+    free(recvcounts);
+    free(displs);
+    free(gathered);
+    free(local);
+}
+
+// Writes the levels below split of this block and sums the counts of the
+// split level over every block, rank 0 then writes the rest of the pyramid
+// as block size. The grid is never gathered
+static void mpi_pyramid(EngineRun *run, const char *dir) {
+    Distributed *dist = (Distributed*)run->state;
+    int split = dist->split;
+    uint32_t *counts = pyramid_from_block(run->grid, dir, run->rank, run->origin_row, run->origin_col, split);
+    int rows = ((run->global_rows - 1) >> split) + 1;
+    int cols = ((run->global_cols - 1) >> split) + 1;
+    size_t words = (size_t)rows * cols * PYRAMID_COLOURS;
+    uint32_t *global = (uint32_t*)calloc(words, sizeof(uint32_t));
+    uint32_t *sum = run->rank == 0 ? (uint32_t*)malloc(words * sizeof(uint32_t)) : NULL;
+    int failed = counts == NULL || global == NULL || (run->rank == 0 && sum == NULL);
+    MPI_Allreduce(MPI_IN_PLACE, &failed, 1, MPI_INT, MPI_LOR, MPI_COMM_WORLD);
+    if (failed) {
+        if (run->rank == 0) printf("Memory allocation failed for the coarse pyramid levels\n");
+        free(counts);
+        free(global);
+        free(sum);
+        return;
+    }
+
+    // Aligned blocks place their counts on whole pixels of the split level
+    int block_rows = ((run->grid->rows - 1) >> split) + 1;
+    int block_cols = ((run->grid->cols - 1) >> split) + 1;
+    for (int i = 0; i < block_rows; i++) {
+        memcpy(global + ((size_t)((run->origin_row >> split) + i) * cols + (run->origin_col >> split)) * PYRAMID_COLOURS,
+               counts + (size_t)i * block_cols * PYRAMID_COLOURS,
+               (size_t)block_cols * PYRAMID_COLOURS * sizeof(uint32_t));
+    }
+    free(counts);
+    MPI_Reduce(global, sum, (int)words, MPI_UINT32_T, MPI_SUM, 0, MPI_COMM_WORLD);
+    free(global);
+    if (run->rank == 0) {
+        pyramid_write_counts(dir, run->ranks, split, run->global_rows, run->global_cols, sum);
+        printf("Image pyramid saved to %s\n", dir);
+    }
+}
+
+// Writes the global grid as a grid file without gathering it: rank 0 sizes
+// the file, then every rank writes its own rows
+static void mpi_save(EngineRun *run, const char *filename) {
+    Grid *grid = run->grid;
+    int failed = 0;
+    if (run->rank == 0) {
+        failed = grid_file_create(filename, run->global_rows, run->global_cols);
+    }
+    MPI_Bcast(&failed, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if (failed) return;
+
+    int fd = grid_file_open(filename);
+    if (fd >= 0) {
+        uint32_t *row = (uint32_t*)malloc(grid->cols * sizeof(uint32_t));
+        for (int i = 1; i <= grid->rows; i++) {
+            for (int j = 1; j <= grid->cols; j++) {
+                row[j - 1] = (uint32_t)grid->sandpile[i][j];
+            }
+            if (grid_file_write(fd, run->global_cols, run->origin_row + i - 1, run->origin_col, row, grid->cols)) {
+                perror("Failed to write grid file");
+                break;
+            }
+        }
+        free(row);
+        close(fd);
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+}
+
+// Per pass logs would need a global sum every pass, the ranks only agree on
+// whether anything toppled
+const Engine mpi_engine = {
+    "mpi", "MPI", "MPIBlocked", NULL, "blocks of a 2D process grid with halo exchange, chosen under mpirun",
+    "out_mpi.ppm", ENGINE_DISTRIBUTED | ENGINE_BLOCKED | ENGINE_FRAMES,
+    mpi_open, mpi_init, mpi_stabilize, mpi_stats, mpi_checksum, mpi_image, mpi_pyramid, mpi_save, mpi_close,
+};
+
+#endif
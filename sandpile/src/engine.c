@@ -0,0 +1,403 @@
+// Table of the engines, their selection, and the driver shared by the
+// serial, OpenMP and MPI executables
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "../include/engine.h"
+#include "../include/sandpile.h"
+#include "../include/tiled.h"
+#include "../include/out.h"
+#include "../include/lattice.h"
+
+static const char *level_labels[NUM_SIMD_LEVELS] = {"Scalar", "AVX2", "AVX512"};
+
+// The serial kernels report through the globals of sandpile.h
+static void serial_begin(EngineRun *run) {
+    pass_log = run->pass_log;
+    frame_writer = run->frames;
+    frame_every = run->opts->frame_every;
+    progress = progress_slot(run->progress, 0);
+}
+
+static void serial_end(EngineRun *run, EngineStats *stats, int passes, double seconds) {
+    stats->passes = passes;
+    stats->seconds = seconds;
+    stats->topples = run_topples;
+    pass_log = NULL;
+    frame_writer = NULL;
+    progress = NULL;
+}
+
+static int run_asynch(EngineRun *run, EngineStats *stats) {
+    serial_begin(run);
+    int passes = topple_asynch(run->grid);
+    serial_end(run, stats, passes, time_async);
+    stats->threads = 1;
+    return passes < 0;
+}
+
+static int run_blocked(EngineRun *run, EngineStats *stats) {
+    serial_begin(run);
+    int passes = topple_blocked(run->grid, run->opts->block_size, run->opts->time_steps);
+    serial_end(run, stats, passes, time_async);
+    stats->threads = 1;
+    return 0;
+}
+
+static int run_synch(EngineRun *run, EngineStats *stats) {
+    serial_begin(run);
+    int passes = topple_synch(run->grid, run->level);
+    serial_end(run, stats, passes, time_sync);
+#ifdef _OPENMP
+    stats->threads = omp_get_max_threads();
+#else
+    stats->threads = 1;
+#endif
+    return passes < 0;
+}
+
+static const Engine asynch_engine = {
+    "asynch", "Serial", NULL, "blocked", "in-place passes in row-major order", "output_serial.ppm",
+    ENGINE_PASS_LOG | ENGINE_FRAMES, NULL, NULL, run_asynch,
+};
+static const Engine blocked_engine = {
+    "blocked", "SerialBlocked", NULL, NULL, "in-place passes over cache resident blocks, see --block and --steps",
+    "output_serial.ppm", ENGINE_BLOCKED | ENGINE_PASS_LOG | ENGINE_FRAMES, NULL, NULL, run_blocked,
+};
+static const Engine synch_engine = {
+    "synch", "Synch", NULL, NULL, "double-buffered passes, vectorised rows shared by OpenMP threads",
+    "output_serial.ppm", ENGINE_SIMD | ENGINE_THREADED | ENGINE_PASS_LOG | ENGINE_FRAMES, NULL, NULL, run_synch,
+};
+
+// The OpenMP engines are 2D only. Registered engines fill the free slots
+#define MAX_ENGINES 8
+static const Engine *engines[MAX_ENGINES] = {
+    &asynch_engine, &blocked_engine, &synch_engine,
+#if !LATTICE_3D
+    &openmp_engine, &wavefront_engine,
+#endif
+};
+
+void engine_register(const Engine *engine) {
+    for (int e = 0; e < MAX_ENGINES; e++) {
+        if (!engines[e]) {
+            engines[e] = engine;
+            return;
+        }
+    }
+    fprintf(stderr, "Warning: no room to register the %s engine\n", engine->name);
+}
+
+void engine_list(FILE *file) {
+    for (int e = 0; e < MAX_ENGINES && engines[e]; e++) {
+        fprintf(file, "  %-9s %s\n", engines[e]->name, engines[e]->description);
+    }
+}
+
+// First of the environment variables mpirun sets for each process (Open MPI,
+// then MPICH and Intel MPI), -1 when not started by mpirun
+static int launch_value(const char *open_mpi, const char *mpich) {
+    const char *value = getenv(open_mpi);
+    if (!value) value = getenv(mpich);
+    return value ? atoi(value) : -1;
+}
+
+// Processes mpirun started, 0 when not started by mpirun
+static int launch_size(void) {
+    int size = launch_value("OMPI_COMM_WORLD_SIZE", "PMI_SIZE");
+    return size < 0 ? 0 : size;
+}
+
+// Rank before MPI is initialised, 0 when not started by mpirun
+static int launch_rank(void) {
+    int rank = launch_value("OMPI_COMM_WORLD_RANK", "PMI_RANK");
+    return rank < 0 ? 0 : rank;
+}
+
+static const Engine* find_engine(const char *name) {
+    for (int e = 0; e < MAX_ENGINES && engines[e]; e++) {
+        if (strcmp(name, engines[e]->name) == 0) return engines[e];
+    }
+    return NULL;
+}
+
+// First engine that runs on several processes, NULL if none is registered
+static const Engine* find_distributed(void) {
+    for (int e = 0; e < MAX_ENGINES && engines[e]; e++) {
+        if (engines[e]->flags & ENGINE_DISTRIBUTED) return engines[e];
+    }
+    return NULL;
+}
+
+// Rejects the options the engine cannot honour instead of ignoring them
+static int check_support(const Engine *engine, const SandpileOptions *opts) {
+    const char *option = NULL;
+    if (opts->blocked && !(engine->flags & ENGINE_BLOCKED)) {
+        option = "--blocked";
+    } else if (opts->simd && !(engine->flags & ENGINE_SIMD)) {
+        option = "--simd";
+    } else if (opts->pass_log && !(engine->flags & ENGINE_PASS_LOG)) {
+        option = "--pass-log";
+    } else if (opts->frame_every && !(engine->flags & ENGINE_FRAMES)) {
+        option = "--frames";
+    }
+    if (option) {
+        fprintf(stderr, "Error: %s is not supported by the %s engine\n", option, engine->name);
+        return 1;
+    }
+    // Every process would run the whole grid and write the same files
+    if (!(engine->flags & ENGINE_DISTRIBUTED) && launch_size() > 1) {
+        const Engine *distributed = find_distributed();
+        if (distributed) {
+            fprintf(stderr, "Error: the %s engine runs in one process, use --engine %s under mpirun\n",
+                    engine->name, distributed->name);
+        } else {
+            fprintf(stderr, "Error: the %s engine runs in one process and this program has no MPI engine, "
+                    "run mpiSandpile under mpirun\n", engine->name);
+        }
+        return 1;
+    }
+    return 0;
+}
+
+const Engine* engine_select(const SandpileOptions *opts, const char *default_engine, SimdLevel *level) {
+    const char *name = opts->engine;
+    if (!name && opts->wavefront) name = "wavefront";
+    if (!name && launch_size() > 0 && find_distributed()) name = find_distributed()->name;
+    if (!name) name = default_engine;
+    if (opts->wavefront && strcmp(name, "wavefront") != 0) {
+        fprintf(stderr, "Error: --wavefront selects the wavefront engine, not %s\n", name);
+        return NULL;
+    }
+    const Engine *engine = find_engine(name);
+    // e.g. the serial blocked kernel is an engine of its own
+    if (engine && opts->blocked && engine->blocked_engine) engine = find_engine(engine->blocked_engine);
+    if (!engine) {
+        fprintf(stderr, "Unknown engine %s, the engines of this program are:\n", name);
+        engine_list(stderr);
+        return NULL;
+    }
+    if (check_support(engine, opts)) return NULL;
+
+    *level = simd_detect();
+    if (opts->simd) {
+        SimdLevel wanted;
+        if (simd_parse(opts->simd, &wanted)) {
+            fprintf(stderr, "Unknown SIMD level %s, use scalar, avx2 or avx512\n", opts->simd);
+            return NULL;
+        }
+        if (wanted > *level) {
+            fprintf(stderr, "Warning: %s is not available for this CPU and lattice, using %s\n",
+                    opts->simd, simd_name(*level));
+        } else {
+            *level = wanted;
+        }
+    }
+    return engine;
+}
+
+void engine_version(const Engine *engine, const SandpileOptions *opts, SimdLevel level, char *buffer, size_t size) {
+    const char *version = opts->blocked && engine->blocked_version ? engine->blocked_version : engine->version;
+    snprintf(buffer, size, "%s%s%s", version, engine->flags & ENGINE_SIMD ? level_labels[level] : "", LATTICE_NAME);
+}
+
+int engine_load(EngineRun *run, const RunConfig *config, int rows, int cols) {
+    if (run->grid == NULL) {
+        run->grid = (Grid*)calloc(1, sizeof(Grid));
+        if (run->grid == NULL) {
+            printf("Memory allocation failed for grid\n");
+            return 1;
+        }
+    }
+    if (grid_resize(run->grid, rows, cols, run->opts->depth)) return 1;
+    grid_load_block(run->grid, &run->opts->init, config->centre, config->allVal, run->origin_row, run->origin_col,
+                    run->global_rows, run->global_cols);
+    return 0;
+}
+
+// Per process files of a distributed engine get the rank as a suffix, <file>.<rank>
+static const char* process_file(const Engine *engine, const EngineRun *run, const char *file, char *buffer,
+                                size_t size) {
+    if (!(engine->flags & ENGINE_DISTRIBUTED)) return file;
+    snprintf(buffer, size, "%s.%d", file, run->rank);
+    return buffer;
+}
+
+// Frame writer and progress sampler of one configuration
+static void start_monitors(const Engine *engine, EngineRun *run) {
+    const SandpileOptions *opts = run->opts;
+    Grid *grid = run->grid;
+    char filename[512];
+    if (opts->frame_every && !run->batch) {
+        run->frames = frames_open(process_file(engine, run, opts->frames_file, filename, sizeof(filename)),
+                                  run->global_rows, run->global_cols, run->origin_row, run->origin_col,
+                                  grid->rows, grid->cols, opts->frames_wait);
+    }
+    // The sampler thread makes no MPI calls, each rank follows its own block
+    if (opts->progress_file) {
+        int slots = 1;
+#ifdef _OPENMP
+        if (engine->flags & ENGINE_THREADED) slots = omp_get_max_threads();
+#endif
+        run->progress = progress_start(process_file(engine, run, opts->progress_file, filename, sizeof(filename)),
+                                       slots, opts->progress_every, run->version, grid->rows, grid->cols);
+    }
+}
+
+static void stop_monitors(EngineRun *run) {
+    progress_stop(run->progress);
+    frames_close(run->frames);
+    run->progress = NULL;
+    run->frames = NULL;
+}
+
+// Timing, checksum and grid outputs of one configuration, the same for every
+// engine. Rank 0 prints and appends to the csv files
+static void write_outputs(const Engine *engine, EngineRun *run, const RunConfig *config, const EngineStats *stats,
+                          FILE *results, FILE *checksums, uint64_t init_key) {
+    const SandpileOptions *opts = run->opts;
+    bool root = run->rank == 0;
+    if (root) {
+        if (run->batch) {
+            printf("%s %dx%d centre %lu all %lu: %lf seconds\n", run->version, config->rows, config->cols,
+                   config->centre, config->allVal, stats->seconds);
+        } else {
+            printf("Simulation completed in %.4f seconds\n", stats->seconds);
+        }
+        printf("%d passes, %ld topples\n", stats->passes, stats->topples);
+        results_append(results, run->version, stats->threads, config->rows, config->cols, config->centre,
+                       config->allVal, stats->seconds);
+    }
+
+    // Cheap enough to run on every production run, outside the timed region
+    GridChecksum sum;
+    if (engine->checksum) {
+        engine->checksum(run, &sum);
+    } else {
+        checksum_from_block(run->grid, 0, 0, run->global_rows, run->global_cols, &sum);
+    }
+    if (root) {
+        checksum_print(&sum);
+        checksums_append(checksums, run->version, stats->threads, config->rows, config->cols, config->centre,
+                         config->allVal, init_key, &sum);
+    }
+
+    // Batch runs only time the simulation, per run outputs would overwrite each other
+    if (run->batch) return;
+    if (opts->pyramid_dir) {
+        if (engine->pyramid) {
+            engine->pyramid(run, opts->pyramid_dir);
+        } else {
+            pyramid_from_grid(run->grid, opts->pyramid_dir);
+        }
+    } else if (engine->image) {
+        engine->image(run, engine->image_file);
+    } else {
+        visualize_grid_as_image(run->grid, engine->image_file);
+    }
+    if (run->pass_log) passlog_write(run->pass_log, opts->pass_log);
+    if (opts->save_file) {
+        if (engine->save) {
+            engine->save(run, opts->save_file);
+        } else {
+            grid_save(run->grid, opts->save_file);
+        }
+    }
+}
+
+// Single process engines hold the whole grid
+static int whole_grid_init(EngineRun *run, const RunConfig *config) {
+    run->origin_row = 0;
+    run->origin_col = 0;
+    return engine_load(run, config, config->rows, config->cols);
+}
+
+// Every configuration of the options with an opened engine, returns the exit status
+static int run_configs(const Engine *engine, EngineRun *run, SandpileOptions *opts) {
+    // Every process maps the grid file, but only touches its own block
+    if (initial_open(&opts->init)) {
+        return 1;
+    }
+    // A batch file lists many configurations, otherwise there is one
+    RunConfig *configs;
+    int num_configs = load_configs(opts, &configs);
+    if (num_configs == 0) {
+        initial_close(&opts->init);
+        return 1;
+    }
+    run->batch = opts->batch_file != NULL;
+
+    FILE *results = run->rank == 0 ? results_open(opts->results_file) : NULL;
+    FILE *checksums = run->rank == 0 ? results_open(opts->checksums_file) : NULL;
+    uint64_t init_key = checksum_run_key(initial_fingerprint(&opts->init), opts->depth);
+
+    // The grid storage, thread pool and process grid stay alive across configurations
+    int status = 0;
+    for (int c = 0; c < num_configs; c++) {
+        run->global_rows = configs[c].rows;
+        run->global_cols = configs[c].cols;
+        if (engine->init ? engine->init(run, &configs[c]) : whole_grid_init(run, &configs[c])) {
+            status = 1;
+            break;
+        }
+
+        PassLog log;
+        passlog_init(&log);
+        run->pass_log = opts->pass_log && !run->batch ? &log : NULL;
+        start_monitors(engine, run);
+        EngineStats stats;
+        int failed = engine->stabilize(run, &stats);
+        stop_monitors(run);
+        if (failed) {
+            passlog_free(&log);
+            run->pass_log = NULL;
+            status = 1;
+            break;
+        }
+        if (engine->stats) engine->stats(run, &stats);
+
+        write_outputs(engine, run, &configs[c], &stats, results, checksums, init_key);
+        run->pass_log = NULL;
+        passlog_free(&log);
+    }
+    if (results) {
+        fclose(results);
+        printf("Data written successfully to %s\n", opts->results_file);
+    }
+    if (checksums) fclose(checksums);
+    free(configs);
+    initial_close(&opts->init);
+    return status;
+}
+
+int engine_main(int argc, char *argv[], const char *default_engine) {
+    // Defaults are set in options_default, override with arguments if provided
+    SandpileOptions opts;
+    if (parse_options(argc, argv, &opts)) {
+        // Under mpirun every process parses the same arguments
+        if (launch_rank() == 0) print_usage(argv[0]);
+        return 1;
+    }
+    EngineRun run;
+    memset(&run, 0, sizeof(run));
+    run.opts = &opts;
+    run.ranks = 1;
+    const Engine *engine = engine_select(&opts, default_engine, &run.level);
+    if (!engine) {
+        return 1;
+    }
+    engine_version(engine, &opts, run.level, run.version, sizeof(run.version));
+    if (engine->open && engine->open(&run)) {
+        return 1;
+    }
+
+    int status = run_configs(engine, &run, &opts);
+
+    grid_free(run.grid);
+    if (engine->close) engine->close(&run);
+    return status;
+}
@@ -0,0 +1,247 @@
+// Background writer for time-lapse frames
+// The compute side fills a slot of a small queue while the writer thread
+// encodes the oldest queued one, so the only cost in the sweep loop is
+// copying the grid into bytes. While the queue is full frames are dropped,
+// or the compute side waits for the writer if the writer was opened to wait.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "../include/frames.h"
+
+struct FrameWriter {
+    FILE *file;
+    int rows, cols, tile;
+    // Ring of frames: head is the oldest queued one, being encoded by the
+    // writer thread, and slot (head + queued) is filled by the compute side
+    unsigned char *slots[FRAMES_QUEUE];
+    int passes[FRAMES_QUEUE];
+    int head, queued;
+    unsigned char *previous; // Last written frame, base for the deltas
+    unsigned char *payload;  // Encoded frame
+    int last_pass; // Pass of the last submitted frame
+    int wait;      // Wait for a free slot instead of dropping the frame
+    int closing;
+    long written, dropped, stalls;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_t thread;
+};
+
+// Encode one tile of frame, returns bytes added to out
+static size_t encode_tile(const FrameWriter *w, const unsigned char *frame, int tile_row, int tile_col,
+                          unsigned char *out) {
+    int r0 = tile_row * w->tile, r1 = r0 + w->tile > w->rows ? w->rows : r0 + w->tile;
+    int c0 = tile_col * w->tile, c1 = c0 + w->tile > w->cols ? w->cols : c0 + w->tile;
+
+    int same = 1;
+    for (int i = r0; i < r1 && same; i++) {
+        if (memcmp(frame + (size_t)i * w->cols + c0, w->previous + (size_t)i * w->cols + c0, c1 - c0)) {
+            same = 0;
+        }
+    }
+    if (same) {
+        out[0] = FRAME_TILE_SAME;
+        return 1;
+    }
+
+    // Stable regions are long runs of the same value
+    size_t n = 1 + sizeof(int32_t);
+    unsigned char value = frame[(size_t)r0 * w->cols + c0];
+    int count = 0;
+    for (int i = r0; i < r1; i++) {
+        for (int j = c0; j < c1; j++) {
+            unsigned char v = frame[(size_t)i * w->cols + j];
+            if (v != value || count == 255) {
+                out[n++] = (unsigned char)count;
+                out[n++] = value;
+                value = v;
+                count = 0;
+            }
+            count++;
+        }
+    }
+    out[n++] = (unsigned char)count;
+    out[n++] = value;
+
+    int32_t size = (int32_t)(n - 1 - sizeof(int32_t));
+    out[0] = FRAME_TILE_RLE;
+    memcpy(out + 1, &size, sizeof(int32_t));
+    return n;
+}
+
+static void write_frame(FrameWriter *w, const unsigned char *frame, int pass) {
+    int tiles_rows = (w->rows + w->tile - 1) / w->tile;
+    int tiles_cols = (w->cols + w->tile - 1) / w->tile;
+
+    size_t n = 0;
+    for (int tr = 0; tr < tiles_rows; tr++) {
+        for (int tc = 0; tc < tiles_cols; tc++) {
+            n += encode_tile(w, frame, tr, tc, w->payload + n);
+        }
+    }
+
+    int32_t record[2] = {pass, (int32_t)n};
+    fwrite(record, sizeof(int32_t), 2, w->file);
+    fwrite(w->payload, 1, n, w->file);
+}
+
+static void* writer_thread(void *arg) {
+    FrameWriter *w = (FrameWriter*)arg;
+
+    pthread_mutex_lock(&w->lock);
+    for (;;) {
+        while (!w->queued && !w->closing) {
+            pthread_cond_wait(&w->cond, &w->lock);
+        }
+        if (!w->queued) break; // Closing with nothing left to write
+        // The compute side never touches the head slot while it is queued
+        unsigned char *frame = w->slots[w->head];
+        int pass = w->passes[w->head];
+        pthread_mutex_unlock(&w->lock);
+
+        write_frame(w, frame, pass);
+
+        pthread_mutex_lock(&w->lock);
+        w->slots[w->head] = w->previous;
+        w->previous = frame;
+        w->head = (w->head + 1) % FRAMES_QUEUE;
+        w->queued--;
+        w->written++;
+        pthread_cond_broadcast(&w->cond);
+    }
+    pthread_mutex_unlock(&w->lock);
+    return NULL;
+}
+
+FrameWriter* frames_open(const char *filename, int global_rows, int global_cols,
+                         int origin_row, int origin_col, int rows, int cols, int wait) {
+    FrameWriter *w = (FrameWriter*)calloc(1, sizeof(FrameWriter));
+    if (w == NULL) {
+        printf("Memory allocation failed for frame writer\n");
+        return NULL;
+    }
+
+    w->file = fopen(filename, "wb");
+    if (!w->file) {
+        perror("Failed to open frames file for writing");
+        free(w);
+        return NULL;
+    }
+
+    w->rows = rows;
+    w->cols = cols;
+    w->tile = FRAMES_TILE;
+    w->last_pass = -1;
+    w->wait = wait;
+    size_t cells = (size_t)rows * cols;
+    // Worst case payload is a tag, a size and one pair per cell for every tile
+    size_t tiles = (size_t)((rows + w->tile - 1) / w->tile) * ((cols + w->tile - 1) / w->tile);
+    int allocated = 1;
+    for (int q = 0; q < FRAMES_QUEUE; q++) {
+        w->slots[q] = (unsigned char*)malloc(cells);
+        allocated = allocated && w->slots[q];
+    }
+    w->previous = (unsigned char*)calloc(cells, 1);
+    w->payload = (unsigned char*)malloc(2 * cells + tiles * (1 + sizeof(int32_t)));
+    if (!allocated || !w->previous || !w->payload) {
+        printf("Memory allocation failed for frame buffers\n");
+        fclose(w->file);
+        for (int q = 0; q < FRAMES_QUEUE; q++) free(w->slots[q]);
+        free(w->previous); free(w->payload);
+        free(w);
+        return NULL;
+    }
+
+    FramesHeader header;
+    memcpy(header.magic, FRAMES_MAGIC, 4);
+    header.global_rows = global_rows;
+    header.global_cols = global_cols;
+    header.origin_row = origin_row;
+    header.origin_col = origin_col;
+    header.rows = rows;
+    header.cols = cols;
+    header.tile = w->tile;
+    fwrite(&header, sizeof(header), 1, w->file);
+
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->cond, NULL);
+    pthread_create(&w->thread, NULL, writer_thread, w);
+    return w;
+}
+
+// Free slot for the next frame, waits while the queue is full. Called with the lock held
+static unsigned char* free_slot(FrameWriter *w) {
+    if (w->queued == FRAMES_QUEUE) w->stalls++;
+    while (w->queued == FRAMES_QUEUE) {
+        pthread_cond_wait(&w->cond, &w->lock);
+    }
+    // head + queued does not change while the writer retires frames
+    return w->slots[(w->head + w->queued) % FRAMES_QUEUE];
+}
+
+unsigned char* frames_begin(FrameWriter *w) {
+    pthread_mutex_lock(&w->lock);
+    unsigned char *frame = NULL;
+    if (w->queued < FRAMES_QUEUE || w->wait) {
+        frame = free_slot(w);
+    } else {
+        w->dropped++;
+    }
+    pthread_mutex_unlock(&w->lock);
+    return frame;
+}
+
+unsigned char* frames_begin_final(FrameWriter *w, int pass) {
+    pthread_mutex_lock(&w->lock);
+    unsigned char *frame = w->last_pass == pass ? NULL : free_slot(w);
+    pthread_mutex_unlock(&w->lock);
+    return frame;
+}
+
+void frames_submit(FrameWriter *w, int pass) {
+    pthread_mutex_lock(&w->lock);
+    w->passes[(w->head + w->queued) % FRAMES_QUEUE] = pass;
+    w->queued++;
+    w->last_pass = pass;
+    pthread_cond_signal(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+}
+
+void frames_capture(FrameWriter *w, Grid *grid, int every, int pass, bool last) {
+    if (!w || (!last && pass % every != 0)) return;
+    unsigned char *frame = last ? frames_begin_final(w, pass) : frames_begin(w);
+    if (!frame) return;
+
+    int cols = grid->cols;
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(static)
+#endif
+    for (int i = 1; i <= grid->rows; i++) {
+        for (int j = 1; j <= cols; j++) {
+            unsigned long int value = grid->sandpile[i][j];
+            frame[(size_t)(i - 1) * cols + j - 1] = value > 255 ? 255 : (unsigned char)value;
+        }
+    }
+    frames_submit(w, pass);
+}
+
+void frames_close(FrameWriter *w) {
+    if (!w) return;
+
+    pthread_mutex_lock(&w->lock);
+    w->closing = 1;
+    pthread_cond_signal(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+    pthread_join(w->thread, NULL);
+
+    printf("Frames written: %ld, dropped: %ld, waits for the writer: %ld\n", w->written, w->dropped, w->stalls);
+    fclose(w->file);
+    pthread_mutex_destroy(&w->lock);
+    pthread_cond_destroy(&w->cond);
+    for (int q = 0; q < FRAMES_QUEUE; q++) free(w->slots[q]);
+    free(w->previous);
+    free(w->payload);
+    free(w);
+}
@@ -1,34 +1,150 @@
 #include "../include/grid.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <unistd.h>
 
-Grid* grid_create(int rows, int cols, unsigned long int centre, unsigned long int allVal) {
-    Grid *grid = (Grid*)malloc(sizeof(Grid));
+Grid* grid_create(int rows, int cols, int depth, unsigned long int centre, unsigned long int allVal) {
+    Grid *grid = (Grid*)calloc(1, sizeof(Grid));
+    if (grid == NULL || grid_reset(grid, rows, cols, depth, centre, allVal)) {
+        grid_free(grid);
+        return NULL;
+    }
+    return grid;
+}
+
+// Size a grid's storage and row pointers without touching the cells. The
+// cell storage is one block that is only reallocated when it has to grow, so
+// batch runs reuse it
+int grid_resize(Grid *grid, int rows, int cols, int depth) {
+    int total_rows = GRID_LAYERS(depth) * (rows + 2);
+    size_t cells = (size_t)total_rows * (cols + 2);
+    if (cells > grid->capacity) {
+        free(grid->cells);
+        grid->cells = (unsigned long int*)malloc(cells * sizeof(unsigned long int));
+        grid->capacity = grid->cells ? cells : 0;
+        if (grid->cells == NULL) {
+            printf("Memory allocation failed for grid cells\n");
+            return 1;
+        }
+    }
+    if (total_rows > grid->row_capacity) {
+        free(grid->layers);
+        grid->layers = (unsigned long int**)malloc(total_rows * sizeof(unsigned long int*));
+        grid->row_capacity = grid->layers ? total_rows : 0;
+        if (grid->layers == NULL) {
+            printf("Memory allocation failed for grid rows\n");
+            return 1;
+        }
+    }
     grid->rows = rows;
     grid->cols = cols;
-    
-    grid->sandpile = (unsigned long int**)malloc((rows + 2) * sizeof(unsigned long int*));
-    for (int i = 0; i <= rows + 1; i++) {
-        grid->sandpile[i] = (unsigned long int*)malloc((cols + 2) * sizeof(unsigned long int));
+    grid->depth = LATTICE_3D ? depth : 1;
+    grid->layer_stride = rows + 2;
+
+    for (int i = 0; i < total_rows; i++) {
+        grid->layers[i] = grid->cells + (size_t)i * (cols + 2);
+    }
+    // Images, frames and checksums see the central layer
+    int centre_layer = LATTICE_3D ? grid->depth / 2 + 1 : 0;
+    grid->sandpile = grid->layers + (size_t)centre_layer * grid->layer_stride;
+    return 0;
+}
+
+// Reinitialise a grid for a new size
+int grid_reset(Grid *grid, int rows, int cols, int depth, unsigned long int centre, unsigned long int allVal) {
+    if (grid_resize(grid, rows, cols, depth)) return 1;
+    int total_rows = GRID_LAYERS(grid->depth) * grid->layer_stride;
+    for (int i = 0; i < total_rows; i++) {
         for (int j = 0; j <= cols + 1; j++) {
-            grid->sandpile[i][j] = allVal;
+            grid->layers[i][j] = allVal;
         }
     }
-
     grid->sandpile[rows/2 + 1][cols/2 + 1] = centre; 
+    return 0;
+}
 
-    return grid;
+void grid_load_block(Grid *grid, const InitialCondition *init, unsigned long int centre, unsigned long int allVal,
+                     int origin_row, int origin_col, int global_rows, int global_cols) {
+    int rows = grid->rows;
+    int cols = grid->cols;
+    int total_rows = GRID_LAYERS(grid->depth) * grid->layer_stride;
+    bool flat = init->kind == INIT_FLAT;
+
+    // Filled in parallel so pages are first touched by the threads that sweep them,
+    // the generators and the mapped file give the same cells for any thread count
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(static)
+#endif
+    for (int r = 0; r < total_rows; r++) {
+        int z = r / grid->layer_stride;
+        int i = r % grid->layer_stride;
+        unsigned long int *row = grid->layers[r];
+        bool ghost = i == 0 || i == rows + 1 || z < GRID_FIRST_LAYER || z > GRID_LAST_LAYER(grid);
+        int tall_row = (z - GRID_FIRST_LAYER) * global_rows + origin_row + i - 1;
+        row[0] = 0;
+        row[cols + 1] = 0;
+        for (int j = 1; j <= cols; j++) {
+            row[j] = ghost ? 0 : flat ? allVal : initial_value(init, tall_row, origin_col + j - 1, global_cols);
+        }
+    }
+
+    if (flat) {
+        int i = global_rows / 2 - origin_row + 1;
+        int j = global_cols / 2 - origin_col + 1;
+        if (i >= 1 && i <= rows && j >= 1 && j <= cols) grid->sandpile[i][j] = centre;
+    }
+    // load_configs has checked that the spikes are on the global grid
+    for (int s = 0; s < init->num_spikes; s++) {
+        const Spike *spike = &init->spikes[s];
+        int z = GRID_FIRST_LAYER + spike->row / global_rows;
+        int i = spike->row % global_rows - origin_row + 1;
+        int j = spike->col - origin_col + 1;
+        if (i >= 1 && i <= rows && j >= 1 && j <= cols) {
+            grid->layers[z * grid->layer_stride + i][j] += spike->value;
+        }
+    }
+}
+
+int grid_save(const Grid *grid, const char *filename) {
+    if (grid_file_create(filename, grid->rows, grid->cols)) return 1;
+    int fd = grid_file_open(filename);
+    if (fd < 0) return 1;
+
+    uint32_t *row = (uint32_t*)malloc(grid->cols * sizeof(uint32_t));
+    int failed = 0;
+    for (int i = 1; i <= grid->rows && !failed; i++) {
+        for (int j = 1; j <= grid->cols; j++) {
+            row[j - 1] = (uint32_t)grid->sandpile[i][j];
+        }
+        failed = grid_file_write(fd, grid->cols, i - 1, 0, row, grid->cols);
+    }
+    free(row);
+    close(fd);
+    return failed;
 }
 
 void add_padding(int rows, int cols, Grid *grid) {
     // Add padding to the grid to avoid boundary checks
-    for (int i = 0; i <= rows + 1; i++) {
-        grid->sandpile[i][0] = 0; // Left padding
-        grid->sandpile[i][cols + 1] = 0; // Right padding
+    for (int z = GRID_FIRST_LAYER; z <= GRID_LAST_LAYER(grid); z++) {
+        unsigned long int **layer = grid->layers + (size_t)z * grid->layer_stride;
+        for (int i = 0; i <= rows + 1; i++) {
+            layer[i][0] = 0; // Left padding
+            layer[i][cols + 1] = 0; // Right padding
+        }
+        for (int j = 0; j <= cols + 1; j++) {
+            layer[0][j] = 0; // Top padding
+            layer[rows + 1][j] = 0; // Bottom padding
+        }
     }
-    for (int j = 0; j <= cols + 1; j++) {
-        grid->sandpile[0][j] = 0; // Top padding
-        grid->sandpile[rows + 1][j] = 0; // Bottom padding
+    // Ghost layers above and below the 3D grid
+    if (LATTICE_3D) {
+        int last = (grid->depth + 1) * grid->layer_stride;
+        for (int i = 0; i < grid->layer_stride; i++) {
+            for (int j = 0; j <= cols + 1; j++) {
+                grid->layers[i][j] = 0;
+                grid->layers[last + i][j] = 0;
+            }
+        }
     }
 }
 
@@ -47,10 +163,8 @@ void grid_print(Grid *grid) {
 
 void grid_free(Grid *grid) {
     if (grid) {
-        for (int i = 0; i < grid->rows+1; i++) {
-            free(grid->sandpile[i]);
-        }
-        free(grid->sandpile);
+        free(grid->cells);
+        free(grid->layers);
         free(grid);
     }
 }
@@ -0,0 +1,227 @@
+// Initial condition generators and the binary grid file format
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../include/initial.h"
+
+void initial_default(InitialCondition *init) {
+    memset(init, 0, sizeof(InitialCondition));
+    init->kind = INIT_FLAT;
+    init->seed = 1;
+}
+
+int initial_parse(const char *spec, InitialCondition *init) {
+    char *end;
+    int overflow = 0;
+    if (strncmp(spec, "uniform:", 8) == 0) {
+        init->kind = INIT_UNIFORM;
+        errno = 0;
+        init->max = strtoul(spec + 8, &end, 10);
+        overflow = errno == ERANGE;
+    } else if (strncmp(spec, "poisson:", 8) == 0) {
+        init->kind = INIT_POISSON;
+        init->mean = strtod(spec + 8, &end);
+    } else if (strncmp(spec, "file:", 5) == 0) {
+        init->kind = INIT_FILE;
+        init->file = spec + 5;
+        return *init->file == '\0';
+    } else {
+        fprintf(stderr, "Unknown initial condition: %s\n", spec);
+        return 1;
+    }
+
+    if (*end == ':') {
+        init->seed = strtoull(end + 1, &end, 10);
+    }
+    if (*end != '\0') {
+        fprintf(stderr, "Malformed initial condition: %s\n", spec);
+        return 1;
+    }
+    // Cells are unsigned long in every engine, max + 1 must fit one. A Poisson
+    // draw is at most about nine standard deviations above the mean, half the
+    // range leaves room for it
+    if ((init->kind == INIT_UNIFORM && (overflow || init->max == ULONG_MAX)) ||
+        (init->kind == INIT_POISSON && !(init->mean >= 0 && init->mean < ULONG_MAX / 2.0))) {
+        fprintf(stderr, "Initial load out of range: %s\n", spec);
+        return 1;
+    }
+    return 0;
+}
+
+int initial_add_spike(const char *spec, InitialCondition *init) {
+    if (init->num_spikes == MAX_SPIKES) {
+        fprintf(stderr, "At most %d spikes are supported\n", MAX_SPIKES);
+        return 1;
+    }
+    Spike *spike = &init->spikes[init->num_spikes];
+    char extra;
+    if (sscanf(spec, "%d,%d,%lu%c", &spike->row, &spike->col, &spike->value, &extra) != 3 ||
+        spike->row < 0 || spike->col < 0) {
+        fprintf(stderr, "Expected ROW,COL,VALUE for a spike: %s\n", spec);
+        return 1;
+    }
+    init->num_spikes++;
+    return 0;
+}
+
+int initial_open(InitialCondition *init) {
+    if (init->kind != INIT_FILE) return 0;
+
+    int fd = open(init->file, O_RDONLY);
+    if (fd < 0) {
+        perror("Failed to open grid file");
+        return 1;
+    }
+    struct stat st;
+    GridFileHeader header;
+    if (fstat(fd, &st) != 0 || read(fd, &header, sizeof(header)) != sizeof(header) ||
+        memcmp(header.magic, GRID_FILE_MAGIC, 4) != 0 || header.rows <= 0 || header.cols <= 0 ||
+        (size_t)st.st_size < sizeof(header) + (size_t)header.rows * header.cols * sizeof(uint32_t)) {
+        fprintf(stderr, "Not a grid file: %s\n", init->file);
+        close(fd);
+        return 1;
+    }
+
+    init->map_size = sizeof(header) + (size_t)header.rows * header.cols * sizeof(uint32_t);
+    void *map = mmap(NULL, init->map_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("Failed to map grid file");
+        return 1;
+    }
+    init->cells = (const uint32_t*)((const char*)map + sizeof(header));
+    init->rows = header.rows;
+    init->cols = header.cols;
+    return 0;
+}
+
+void initial_close(InitialCondition *init) {
+    if (init->cells) {
+        munmap((char*)init->cells - sizeof(GridFileHeader), init->map_size);
+        init->cells = NULL;
+    }
+}
+
+// SplitMix64 finaliser, a bijective mix of all 64 bits
+static inline uint64_t mix64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+// Counter-based generator: draw k of cell index is a hash of (seed, index, k),
+// there is no state to carry between cells, threads or ranks
+static inline uint64_t draw(uint64_t key, int k) {
+    return mix64(key + (uint64_t)(k + 1) * 0x9e3779b97f4a7c15ULL);
+}
+
+// Uniform double in (0, 1]
+static inline double draw_unit(uint64_t key, int k) {
+    return ((draw(key, k) >> 11) + 1) * (1.0 / 9007199254740992.0);
+}
+
+static unsigned long int poisson(uint64_t key, double mean) {
+    if (mean < 30) {
+        // Knuth: count uniforms until their product drops below e^-mean
+        double limit = exp(-mean);
+        double product = draw_unit(key, 0);
+        unsigned long int n = 0;
+        while (product > limit) {
+            n++;
+            product *= draw_unit(key, (int)n);
+        }
+        return n;
+    }
+    // Normal approximation from Box-Muller, exact enough for large means
+    double z = sqrt(-2.0 * log(draw_unit(key, 0))) * cos(6.283185307179586 * draw_unit(key, 1));
+    double value = floor(mean + sqrt(mean) * z + 0.5);
+    return value < 0 ? 0 : (unsigned long int)value;
+}
+
+unsigned long int initial_value(const InitialCondition *init, int row, int col, int cols) {
+    size_t index = (size_t)row * cols + col;
+    uint64_t key = mix64(init->seed ^ mix64(index));
+    switch (init->kind) {
+    case INIT_UNIFORM:
+        // 32 bit draws keep the values of earlier runs, larger maxima need all 64
+        if (init->max <= 0xffffffffUL) {
+            return (unsigned long int)(((draw(key, 0) >> 32) * (init->max + 1)) >> 32);
+        }
+        return (unsigned long int)(((unsigned __int128)draw(key, 0) * (init->max + 1)) >> 64);
+    case INIT_POISSON:
+        return poisson(key, init->mean);
+    case INIT_FILE:
+        return init->cells[(size_t)row * init->cols + col];
+    default:
+        return 0;
+    }
+}
+
+uint64_t initial_fingerprint(const InitialCondition *init) {
+    if (init->kind == INIT_FLAT && init->num_spikes == 0) return 0;
+
+    uint64_t key = mix64((uint64_t)init->kind + 1);
+    switch (init->kind) {
+    case INIT_UNIFORM:
+        key = mix64(key ^ init->max) ^ init->seed;
+        break;
+    case INIT_POISSON: {
+        uint64_t bits;
+        memcpy(&bits, &init->mean, sizeof(bits));
+        key = mix64(key ^ bits) ^ init->seed;
+        break;
+    }
+    case INIT_FILE:
+        for (const char *c = init->file; *c; c++) key = mix64(key ^ (unsigned char)*c);
+        break;
+    default:
+        break;
+    }
+    for (int s = 0; s < init->num_spikes; s++) {
+        const Spike *spike = &init->spikes[s];
+        key = mix64(key ^ (((uint64_t)spike->row << 32) | (uint32_t)spike->col));
+        key = mix64(key ^ spike->value);
+    }
+    return key;
+}
+
+int grid_file_create(const char *filename, int rows, int cols) {
+    int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror("Failed to create grid file");
+        return 1;
+    }
+    GridFileHeader header;
+    memcpy(header.magic, GRID_FILE_MAGIC, 4);
+    header.rows = rows;
+    header.cols = cols;
+    header.reserved = 0;
+    int failed = write(fd, &header, sizeof(header)) != sizeof(header) ||
+                 ftruncate(fd, sizeof(header) + (off_t)rows * cols * sizeof(uint32_t)) != 0;
+    if (failed) perror("Failed to write grid file");
+    close(fd);
+    return failed;
+}
+
+int grid_file_open(const char *filename) {
+    int fd = open(filename, O_WRONLY);
+    if (fd < 0) perror("Failed to open grid file");
+    return fd;
+}
+
+int grid_file_write(int fd, int cols, int row, int col, const uint32_t *values, int count) {
+    off_t offset = sizeof(GridFileHeader) + ((off_t)row * cols + col) * sizeof(uint32_t);
+    size_t bytes = (size_t)count * sizeof(uint32_t);
+    return pwrite(fd, values, bytes, offset) != (ssize_t)bytes;
+}
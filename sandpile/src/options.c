@@ -0,0 +1,241 @@
+// Parse the command line shared by all three versions
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/options.h"
+#include "../include/lattice.h"
+#include "../include/progress.h"
+#include "../include/frames.h"
+
+void options_default(SandpileOptions *opts) {
+    opts->rows = 60;
+    opts->cols = 30;
+    opts->centre = 12121;
+    opts->allVal = 624;
+    opts->depth = 1;
+    opts->blocked = false;
+    opts->engine = NULL;
+    opts->simd = NULL;
+    opts->block_size = DEFAULT_BLOCK_SIZE;
+    opts->time_steps = DEFAULT_TIME_STEPS;
+    opts->wavefront = false;
+    opts->pass_log = NULL;
+    opts->frame_every = 0;
+    opts->frames_file = "frames.spf";
+    opts->frames_wait = false;
+    opts->pyramid_dir = NULL;
+    opts->batch_file = NULL;
+    opts->results_file = DEFAULT_RESULTS_FILE;
+    opts->checksums_file = DEFAULT_CHECKSUMS_FILE;
+    initial_default(&opts->init);
+    opts->save_file = NULL;
+    opts->progress_file = NULL;
+    opts->progress_every = DEFAULT_PROGRESS_EVERY;
+}
+
+void print_usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [rows cols centre allVal] [options]\n", prog);
+    fprintf(stderr, "  --blocked          use the temporally blocked kernel of the engine\n");
+    fprintf(stderr, "  --block N          block side length (default %d)\n", DEFAULT_BLOCK_SIZE);
+    fprintf(stderr, "  --steps T          sweeps per block (default %d)\n", DEFAULT_TIME_STEPS);
+    fprintf(stderr, "  --engine NAME      asynch, blocked, synch, openmp, wavefront, or mpi in\n");
+    fprintf(stderr, "                     mpiSandpile (default per program, mpi under mpirun)\n");
+    fprintf(stderr, "  --simd LEVEL       row kernel of the synch engine: scalar, avx2 or avx512\n");
+    fprintf(stderr, "                     (default the best this CPU runs)\n");
+    fprintf(stderr, "  --wavefront        same as --engine wavefront, OpenMP in the serial sweep order\n");
+    fprintf(stderr, "  --pass-log FILE    write topples per pass to FILE (not MPI)\n");
+    fprintf(stderr, "  --frames N         capture a time-lapse frame every N passes\n");
+    fprintf(stderr, "  --frames-file FILE frames container (default frames.spf)\n");
+    fprintf(stderr, "  --frames-wait      keep every frame, pausing the run while the writer is\n");
+    fprintf(stderr, "                     %d frames behind (default: drop those frames)\n", FRAMES_QUEUE);
+    fprintf(stderr, "  --pyramid DIR      write a tiled image pyramid instead of one PPM\n");
+    fprintf(stderr, "  --batch FILE       run each \"rows cols centre allVal\" line of FILE\n");
+    fprintf(stderr, "                     in this process, without image output\n");
+    fprintf(stderr, "  --results FILE     csv file timings are appended to\n");
+    fprintf(stderr, "  --checksums FILE   csv file final grid checksums are appended to\n");
+    fprintf(stderr, "  --init SPEC        base load instead of centre and allVal:\n");
+    fprintf(stderr, "                     uniform:MAX[:SEED], poisson:MEAN[:SEED] or file:PATH\n");
+    fprintf(stderr, "  --spike R,C,V      add V grains at row R, column C (0-based), repeatable\n");
+    fprintf(stderr, "  --save FILE        write the final grid as a grid file for --init file:\n");
+    fprintf(stderr, "  --depth D          layers of a cubic lattice build (default 1)\n");
+    fprintf(stderr, "  --progress FILE    append live progress samples to FILE (MPI: FILE.rank)\n");
+    fprintf(stderr, "  --progress-every S seconds between samples (default %d)\n", DEFAULT_PROGRESS_EVERY);
+}
+
+// Reads the integer value following a flag
+static int flag_value(int argc, char *argv[], int *i, int *out) {
+    if (*i + 1 >= argc) {
+        fprintf(stderr, "Missing value for %s\n", argv[*i]);
+        return 1;
+    }
+    *out = atoi(argv[++(*i)]);
+    return 0;
+}
+
+// Reads the string value following a flag
+static int flag_string(int argc, char *argv[], int *i, const char **out) {
+    if (*i + 1 >= argc) {
+        fprintf(stderr, "Missing value for %s\n", argv[*i]);
+        return 1;
+    }
+    *out = argv[++(*i)];
+    return 0;
+}
+
+int parse_options(int argc, char *argv[], SandpileOptions *opts) {
+    options_default(opts);
+
+    int i = 1;
+    // Positional grid parameters come first and are optional as a group
+    if (argc >= 5 && strncmp(argv[1], "--", 2) != 0) {
+        opts->rows = atoi(argv[1]);
+        opts->cols = atoi(argv[2]);
+        opts->centre = strtoul(argv[3], NULL, 10);
+        opts->allVal = strtoul(argv[4], NULL, 10);
+        i = 5;
+    }
+
+    for (; i < argc; i++) {
+        if (strcmp(argv[i], "--blocked") == 0) {
+            opts->blocked = true;
+        } else if (strcmp(argv[i], "--block") == 0) {
+            if (flag_value(argc, argv, &i, &opts->block_size)) return 1;
+        } else if (strcmp(argv[i], "--steps") == 0) {
+            if (flag_value(argc, argv, &i, &opts->time_steps)) return 1;
+        } else if (strcmp(argv[i], "--engine") == 0) {
+            if (flag_string(argc, argv, &i, &opts->engine)) return 1;
+        } else if (strcmp(argv[i], "--simd") == 0) {
+            if (flag_string(argc, argv, &i, &opts->simd)) return 1;
+        } else if (strcmp(argv[i], "--wavefront") == 0) {
+            opts->wavefront = true;
+        } else if (strcmp(argv[i], "--pass-log") == 0) {
+            if (flag_string(argc, argv, &i, &opts->pass_log)) return 1;
+        } else if (strcmp(argv[i], "--frames") == 0) {
+            if (flag_value(argc, argv, &i, &opts->frame_every)) return 1;
+        } else if (strcmp(argv[i], "--frames-file") == 0) {
+            if (flag_string(argc, argv, &i, &opts->frames_file)) return 1;
+        } else if (strcmp(argv[i], "--frames-wait") == 0) {
+            opts->frames_wait = true;
+        } else if (strcmp(argv[i], "--pyramid") == 0) {
+            if (flag_string(argc, argv, &i, &opts->pyramid_dir)) return 1;
+        } else if (strcmp(argv[i], "--batch") == 0) {
+            if (flag_string(argc, argv, &i, &opts->batch_file)) return 1;
+        } else if (strcmp(argv[i], "--results") == 0) {
+            if (flag_string(argc, argv, &i, &opts->results_file)) return 1;
+        } else if (strcmp(argv[i], "--checksums") == 0) {
+            if (flag_string(argc, argv, &i, &opts->checksums_file)) return 1;
+        } else if (strcmp(argv[i], "--init") == 0) {
+            const char *spec;
+            if (flag_string(argc, argv, &i, &spec) || initial_parse(spec, &opts->init)) return 1;
+        } else if (strcmp(argv[i], "--spike") == 0) {
+            const char *spec;
+            if (flag_string(argc, argv, &i, &spec) || initial_add_spike(spec, &opts->init)) return 1;
+        } else if (strcmp(argv[i], "--save") == 0) {
+            if (flag_string(argc, argv, &i, &opts->save_file)) return 1;
+        } else if (strcmp(argv[i], "--depth") == 0) {
+            if (flag_value(argc, argv, &i, &opts->depth)) return 1;
+        } else if (strcmp(argv[i], "--progress") == 0) {
+            if (flag_string(argc, argv, &i, &opts->progress_file)) return 1;
+        } else if (strcmp(argv[i], "--progress-every") == 0) {
+            if (flag_value(argc, argv, &i, &opts->progress_every)) return 1;
+        } else {
+            fprintf(stderr, "Unknown argument: %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    if (opts->rows <= 0 || opts->cols <= 0) {
+        fprintf(stderr, "Error: rows and columns must be positive integers\n");
+        return 1;
+    }
+    if (opts->frame_every < 0) {
+        fprintf(stderr, "Error: frame interval must not be negative\n");
+        return 1;
+    }
+    if (opts->progress_every <= 0) {
+        fprintf(stderr, "Error: progress interval must be positive\n");
+        return 1;
+    }
+    if (opts->block_size <= 0 || opts->time_steps <= 0) {
+        fprintf(stderr, "Error: block size and steps must be positive\n");
+        return 1;
+    }
+    if (opts->depth <= 0 || (opts->depth > 1 && !LATTICE_3D)) {
+        fprintf(stderr, "Error: depth must be 1 unless built with LATTICE=CUBIC\n");
+        return 1;
+    }
+    if (opts->init.kind == INIT_FILE && opts->depth > 1) {
+        fprintf(stderr, "Error: a grid file holds one layer, it cannot be used with --depth\n");
+        return 1;
+    }
+    if (opts->init.kind == INIT_FILE && opts->batch_file) {
+        fprintf(stderr, "Error: a grid file fixes the size, it cannot be used with --batch\n");
+        return 1;
+    }
+    return 0;
+}
+
+// Every --spike must land on the grid of every configuration, in 3D the rows
+// of the layers are stacked. Returns count, or 0 after freeing the configurations
+static int check_spikes(const SandpileOptions *opts, RunConfig **configs, int count) {
+    for (int c = 0; c < count; c++) {
+        long rows = (long)(*configs)[c].rows * opts->depth;
+        for (int s = 0; s < opts->init.num_spikes; s++) {
+            const Spike *spike = &opts->init.spikes[s];
+            if (spike->row >= rows || spike->col >= (*configs)[c].cols) {
+                fprintf(stderr, "Spike %d,%d is outside the %ldx%d grid\n", spike->row, spike->col,
+                        rows, (*configs)[c].cols);
+                count = 0;
+            }
+        }
+    }
+    if (count == 0) {
+        free(*configs);
+        *configs = NULL;
+    }
+    return count;
+}
+
+int load_configs(const SandpileOptions *opts, RunConfig **configs) {
+    if (!opts->batch_file) {
+        *configs = (RunConfig*)malloc(sizeof(RunConfig));
+        bool from_file = opts->init.kind == INIT_FILE;
+        (*configs)[0].rows = from_file ? opts->init.rows : opts->rows;
+        (*configs)[0].cols = from_file ? opts->init.cols : opts->cols;
+        (*configs)[0].centre = opts->centre;
+        (*configs)[0].allVal = opts->allVal;
+        return check_spikes(opts, configs, 1);
+    }
+
+    FILE *file = fopen(opts->batch_file, "r");
+    if (!file) {
+        perror("Failed to open batch file");
+        return 0;
+    }
+
+    int count = 0, capacity = 64;
+    *configs = (RunConfig*)malloc(capacity * sizeof(RunConfig));
+    char line[256];
+    int line_number = 0;
+    while (fgets(line, sizeof(line), file)) {
+        line_number++;
+        char *start = line + strspn(line, " \t");
+        if (*start == '#' || *start == '\n' || *start == '\0') continue;
+
+        RunConfig config;
+        if (sscanf(start, "%d %d %lu %lu", &config.rows, &config.cols, &config.centre, &config.allVal) != 4 ||
+            config.rows <= 0 || config.cols <= 0) {
+            fprintf(stderr, "%s:%d: expected \"rows cols centre allVal\"\n", opts->batch_file, line_number);
+            count = 0;
+            break;
+        }
+        if (count == capacity) {
+            capacity *= 2;
+            *configs = (RunConfig*)realloc(*configs, capacity * sizeof(RunConfig));
+        }
+        (*configs)[count++] = config;
+    }
+    fclose(file);
+    return check_spikes(opts, configs, count);
+}
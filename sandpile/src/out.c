@@ -1,84 +1,29 @@
 // Visualize the grid as an image
-// Write results to a file
+// Append results to a csv file
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include "../include/grid.h"
+#include "../include/pyramid.h"
 
-void write_results(const char *filename, const char *version, int numThreads, int rows, int cols,
-    unsigned long int centre, unsigned long int allVal, double async_time) {
-
+// Open the results csv once so batch runs can stream rows into it
+FILE* results_open(const char *filename) {
     FILE *file = fopen(filename, "a");
     if (!file) {
         perror("Failed to open file for writing");
-        printf("Error opening file: %s\n", filename); // Debug print
-        return;
+        printf("Error opening file: %s\n", filename);
     }
-    // fprintf(file, "Version: %s\n", version);
-    // fprintf(file, "Threads: %d\n", numThreads);
-    // fprintf(file, "Rows: %d\n", rows);
-    // fprintf(file, "Cols: %d\n", cols);
-    // fprintf(file, "Centre: %lu\n", centre);
-    // fprintf(file, "AllVal: %lu\n", allVal);
-    // fprintf(file, "Time: %lf seconds\n", async_time);
-    // fprintf(file, "----------------------------------------\n");
-    // Make csv file
-    fprintf(file, "%s,%d,%d,%d,%lu,%lu,%lf\n", version, numThreads, rows, cols, centre, allVal, async_time);
-    fclose(file);
-    printf("Data written successfully to %s\n", filename); // Debug print
+    return file;
 }
 
-void gridWrite(FILE *file, int** sandpile, int i, int j, int value) {
-    value = sandpile[i][j];
-    if (value == 0) {
-        fprintf(file, "0 0 0 ");
-
-    } else if (value == 1) {
-        fprintf(file, "0 255 0 ");
-    } else if (value == 2) {
-        fprintf(file, "0 0 255 ");
-
-    } else if (value == 3) {
-        // Red
-        fprintf(file, "255 0 0 ");
-    }
-
-    fprintf(file, "\n");
-}
-
-// Function to visualize the grid as a PPM image
-void vis_grid(int** sandpile, const char *filename, int rows, int cols, bool mpi) {
-    FILE *file = fopen(filename, "w");
-    if (!file) {
-        perror("Failed to open file for writing.");
-        return;
-    }
-
-    // write the PPM header
-    fprintf(file, "P3\n"); // P3 indicates plain-text PPM format
-    fprintf(file, "%d %d\n", cols, rows); // Width and height
-    fprintf(file, "255\n"); // Maximum color value (0-255)
-
-    unsigned long int value = 0;
-    if (!mpi) {
-    // Write pixel data
-    for (int i = 1; i <= rows; i++) {
-        for (int j = 1; j <= cols; j++) {
-            gridWrite(file, sandpile, i, j, value);
-        }
-    }
-    }
-    else {
-        for (int i = 0; i < rows; i++) {
-            for (int j = 0; j < cols; j++) {
-                gridWrite(file, sandpile, i, j, value);
-            }
-        }
-    }
-
-    fclose(file);
-    printf("Image saved to %s\n", filename);
+void results_append(FILE *file, const char *version, int numThreads, int rows, int cols,
+    unsigned long int centre, unsigned long int allVal, double async_time) {
+    if (!file) return;
+    // Make csv file
+    fprintf(file, "%s,%d,%d,%d,%lu,%lu,%lf\n", version, numThreads, rows, cols, centre, allVal, async_time);
+    // Flush so finished runs are on disk even if the job is killed
+    fflush(file);
 }
 
 // Function to visualize the grid as a PPM image
@@ -111,6 +56,8 @@ void visualize_grid_as_image(Grid *grid, const char *filename) {
             } else if (value == 3) {
                 // Light gray for higher values
                 fprintf(file, "255 0 0 ");
+            } else {
+                fprintf(file, "255 255 255 ");
             }
 
         fprintf(file, "\n");
@@ -120,3 +67,44 @@ void visualize_grid_as_image(Grid *grid, const char *filename) {
     fclose(file);
     printf("Image saved to %s\n", filename);
 }
+
+// Colour indices of the interior cells for the pyramid, 4 for 4 or more grains
+static unsigned char* grid_colours(Grid *grid) {
+    int rows = grid->rows;
+    int cols = grid->cols;
+    unsigned char *colours = (unsigned char*)malloc((size_t)rows * cols);
+    if (colours == NULL) {
+        printf("Memory allocation failed for pyramid colours\n");
+        return NULL;
+    }
+
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(static)
+#endif
+    for (int i = 1; i <= rows; i++) {
+        for (int j = 1; j <= cols; j++) {
+            unsigned long int value = grid->sandpile[i][j];
+            colours[(size_t)(i - 1) * cols + j - 1] = value > 4 ? 4 : (unsigned char)value;
+        }
+    }
+    return colours;
+}
+
+// Write the grid as a tiled image pyramid, see pyramid.h
+void pyramid_from_grid(Grid *grid, const char *dir) {
+    unsigned char *colours = grid_colours(grid);
+    if (colours == NULL) return;
+    pyramid_write(dir, 0, 0, 0, grid->rows, grid->cols, colours);
+    free(colours);
+    printf("Image pyramid saved to %s\n", dir);
+}
+
+// Levels below split of the block, see pyramid_write_block
+uint32_t* pyramid_from_block(Grid *grid, const char *dir, int block, int origin_row, int origin_col, int split) {
+    unsigned char *colours = grid_colours(grid);
+    if (colours == NULL) return NULL;
+    uint32_t *counts = pyramid_write_block(dir, block, origin_row, origin_col, grid->rows, grid->cols, colours,
+                                           split);
+    free(colours);
+    return counts;
+}
@@ -0,0 +1,44 @@
+// Record how many cells toppled in every pass so runs can be diffed
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "../include/passlog.h"
+
+void passlog_init(PassLog *log) {
+    log->topples = NULL;
+    log->count = 0;
+    log->capacity = 0;
+}
+
+void passlog_add(PassLog *log, long topples) {
+    if (log->count == log->capacity) {
+        int capacity = log->capacity ? log->capacity * 2 : 1024;
+        long *grown = (long*)realloc(log->topples, capacity * sizeof(long));
+        if (grown == NULL) {
+            printf("Memory allocation failed for pass log\n");
+            return;
+        }
+        log->topples = grown;
+        log->capacity = capacity;
+    }
+    log->topples[log->count++] = topples;
+}
+
+void passlog_write(const PassLog *log, const char *filename) {
+    FILE *file = fopen(filename, "w");
+    if (!file) {
+        perror("Failed to open pass log for writing");
+        return;
+    }
+    fprintf(file, "pass,topples\n");
+    for (int i = 0; i < log->count; i++) {
+        fprintf(file, "%d,%ld\n", i + 1, log->topples[i]);
+    }
+    fclose(file);
+    printf("Pass log saved to %s\n", filename);
+}
+
+void passlog_free(PassLog *log) {
+    free(log->topples);
+    passlog_init(log);
+}
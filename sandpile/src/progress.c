@@ -0,0 +1,153 @@
+// Sidecar thread sampling the progress slots of a run
+// Workers only store into their own slots, all summing, rates and file I/O
+// happen here, off the toppling loops.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include "../include/progress.h"
+
+struct ProgressMonitor {
+    FILE *file;
+    ProgressSlot *slots;
+    int num_slots;
+    int interval;
+    int stopping;
+    struct timespec start;
+    // Previous sample, the base for the rates
+    double last_time;
+    long last_topples, last_unstable;
+    double shrink_rate; // Smoothed unstable cells retired per second, < 0 before the second sample
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_t thread;
+};
+
+static double elapsed_since(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) * 1e-9;
+}
+
+static void write_sample(ProgressMonitor *m) {
+    double time = elapsed_since(&m->start);
+    long pass = 0, topples = 0, unstable = 0, active = 0;
+    for (int s = 0; s < m->num_slots; s++) {
+        ProgressSlot *slot = &m->slots[s];
+        long slot_pass = atomic_load_explicit(&slot->pass, memory_order_relaxed);
+        // Bands of the wavefront run at different passes, report the slowest
+        if (slot_pass > 0 && (pass == 0 || slot_pass < pass)) pass = slot_pass;
+        topples += atomic_load_explicit(&slot->topples, memory_order_relaxed);
+        unstable += atomic_load_explicit(&slot->unstable, memory_order_relaxed);
+        active += atomic_load_explicit(&slot->active, memory_order_relaxed);
+    }
+
+    double dt = time - m->last_time;
+    double topples_per_sec = dt > 0 ? (topples - m->last_topples) / dt : 0;
+    // The run ends when no cell is above threshold, extrapolate how fast that
+    // set shrinks. The swept region is no use here, the wavefront always
+    // sweeps the whole grid
+    if (dt > 0) {
+        double shrink = (m->last_unstable - unstable) / dt;
+        m->shrink_rate = m->shrink_rate < 0 ? shrink : 0.5 * m->shrink_rate + 0.5 * shrink;
+    }
+    double eta = m->shrink_rate > 0 ? unstable / m->shrink_rate : -1;
+
+    fprintf(m->file, "%.1f,%ld,%ld,%.0f,%ld,%ld,%.0f\n", time, pass, topples, topples_per_sec,
+            unstable, active, eta);
+    fflush(m->file);
+    m->last_time = time;
+    m->last_topples = topples;
+    m->last_unstable = unstable;
+}
+
+static void* sampler_thread(void *arg) {
+    ProgressMonitor *m = (ProgressMonitor*)arg;
+
+    pthread_mutex_lock(&m->lock);
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    while (!m->stopping) {
+        deadline.tv_sec += m->interval;
+        int timed_out = 0;
+        while (!m->stopping && !timed_out) {
+            timed_out = pthread_cond_timedwait(&m->cond, &m->lock, &deadline) == ETIMEDOUT;
+        }
+        if (m->stopping) break;
+        pthread_mutex_unlock(&m->lock);
+        write_sample(m);
+        pthread_mutex_lock(&m->lock);
+    }
+    pthread_mutex_unlock(&m->lock);
+    return NULL;
+}
+
+ProgressMonitor* progress_start(const char *filename, int num_slots, int interval, const char *version,
+                                int rows, int cols) {
+    ProgressMonitor *m = (ProgressMonitor*)calloc(1, sizeof(ProgressMonitor));
+    if (m == NULL) {
+        printf("Memory allocation failed for progress monitor\n");
+        return NULL;
+    }
+    m->slots = (ProgressSlot*)aligned_alloc(PROGRESS_SLOT_BYTES, num_slots * sizeof(ProgressSlot));
+    m->file = fopen(filename, "a");
+    if (m->slots == NULL || m->file == NULL) {
+        perror("Failed to open progress file");
+        if (m->file) fclose(m->file);
+        free(m->slots);
+        free(m);
+        return NULL;
+    }
+    for (int s = 0; s < num_slots; s++) {
+        atomic_init(&m->slots[s].pass, 0);
+        atomic_init(&m->slots[s].topples, 0);
+        atomic_init(&m->slots[s].unstable, 0);
+        atomic_init(&m->slots[s].active, 0);
+    }
+    m->num_slots = num_slots;
+    m->interval = interval;
+    m->shrink_rate = -1;
+    clock_gettime(CLOCK_MONOTONIC, &m->start);
+
+    // One header per run, runs of a batch follow each other in the same file
+    fprintf(m->file, "# %s %dx%d, %d slots, sampled every %d seconds\n", version, rows, cols, num_slots, interval);
+    fprintf(m->file, "seconds,passes,topples,topples_per_sec,unstable,active,eta_seconds\n");
+    fflush(m->file);
+
+    pthread_mutex_init(&m->lock, NULL);
+    pthread_cond_init(&m->cond, NULL);
+    if (pthread_create(&m->thread, NULL, sampler_thread, m) != 0) {
+        printf("Failed to start progress thread\n");
+        pthread_mutex_destroy(&m->lock);
+        pthread_cond_destroy(&m->cond);
+        fclose(m->file);
+        free(m->slots);
+        free(m);
+        return NULL;
+    }
+    return m;
+}
+
+ProgressSlot* progress_slot(ProgressMonitor *monitor, int slot) {
+    return monitor ? &monitor->slots[slot] : NULL;
+}
+
+void progress_stop(ProgressMonitor *monitor) {
+    if (!monitor) return;
+
+    pthread_mutex_lock(&monitor->lock);
+    monitor->stopping = 1;
+    pthread_cond_signal(&monitor->cond);
+    pthread_mutex_unlock(&monitor->lock);
+    pthread_join(monitor->thread, NULL);
+
+    write_sample(monitor);
+    fprintf(monitor->file, "# done after %.2f seconds\n", monitor->last_time);
+    fclose(monitor->file);
+    pthread_mutex_destroy(&monitor->lock);
+    pthread_cond_destroy(&monitor->cond);
+    free(monitor->slots);
+    free(monitor);
+}
@@ -0,0 +1,235 @@
+// Build and write a tiled image pyramid for one block of the grid
+// Loops use OpenMP when the executable is built with -fopenmp
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include "../include/pyramid.h"
+
+// Same colours as visualize_grid_as_image, white for the 4 or more grains
+// stable on the Moore and hex lattices
+static const unsigned char pyramid_colours[PYRAMID_COLOURS][3] = {
+    {0, 0, 0}, {0, 255, 0}, {0, 0, 255}, {255, 0, 0}, {255, 255, 255}};
+
+static inline int colour_index(unsigned char value) {
+    return value < PYRAMID_COLOURS - 1 ? value : PYRAMID_COLOURS - 1;
+}
+
+static void write_tile(const char *dir, int block, int level, int tile_row, int tile_col,
+                       const unsigned char *image, int rows, int cols) {
+    int r0 = tile_row * PYRAMID_TILE, r1 = r0 + PYRAMID_TILE > rows ? rows : r0 + PYRAMID_TILE;
+    int c0 = tile_col * PYRAMID_TILE, c1 = c0 + PYRAMID_TILE > cols ? cols : c0 + PYRAMID_TILE;
+
+    char filename[512];
+    snprintf(filename, sizeof(filename), "%s/b%d_L%d_%d_%d.ppm", dir, block, level, tile_row, tile_col);
+    FILE *file = fopen(filename, "wb");
+    if (!file) {
+        perror("Failed to open pyramid tile for writing");
+        return;
+    }
+
+    unsigned char row[PYRAMID_TILE * 3];
+    fprintf(file, "P6\n%d %d\n255\n", c1 - c0, r1 - r0);
+    for (int i = r0; i < r1; i++) {
+        for (int j = c0; j < c1; j++) {
+            const unsigned char *rgb = pyramid_colours[colour_index(image[(size_t)i * cols + j])];
+            row[(j - c0) * 3] = rgb[0];
+            row[(j - c0) * 3 + 1] = rgb[1];
+            row[(j - c0) * 3 + 2] = rgb[2];
+        }
+        fwrite(row, 3, c1 - c0, file);
+    }
+    fclose(file);
+}
+
+static void write_level(const char *dir, int block, int level, const unsigned char *image, int rows, int cols) {
+    int tiles_rows = (rows + PYRAMID_TILE - 1) / PYRAMID_TILE;
+    int tiles_cols = (cols + PYRAMID_TILE - 1) / PYRAMID_TILE;
+
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic)
+#endif
+    for (int t = 0; t < tiles_rows * tiles_cols; t++) {
+        write_tile(dir, block, level, t / tiles_cols, t % tiles_cols, image, rows, cols);
+    }
+}
+
+// Colour counts of the next level, each pixel summing the 2x2 pixels of the
+// h x w level below. At level 0 the counts come from the colours of the cells,
+// above it from hist, so every level is an exact majority of its cells
+static uint32_t* downsample(const unsigned char *colours, const uint32_t *hist, int h, int w) {
+    int nh = (h + 1) / 2, nw = (w + 1) / 2;
+    uint32_t *next = (uint32_t*)malloc((size_t)nh * nw * PYRAMID_COLOURS * sizeof(uint32_t));
+    if (next == NULL) return NULL;
+
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(static)
+#endif
+    for (int y = 0; y < nh; y++) {
+        for (int x = 0; x < nw; x++) {
+            uint32_t *counts = next + ((size_t)y * nw + x) * PYRAMID_COLOURS;
+            for (int c = 0; c < PYRAMID_COLOURS; c++) counts[c] = 0;
+            for (int dy = 0; dy < 2; dy++) {
+                for (int dx = 0; dx < 2; dx++) {
+                    int sy = 2 * y + dy, sx = 2 * x + dx;
+                    if (sy >= h || sx >= w) continue;
+                    size_t src = (size_t)sy * w + sx;
+                    if (hist == NULL) {
+                        counts[colour_index(colours[src])]++;
+                    } else {
+                        for (int c = 0; c < PYRAMID_COLOURS; c++) counts[c] += hist[src * PYRAMID_COLOURS + c];
+                    }
+                }
+            }
+        }
+    }
+    return next;
+}
+
+// Most common colour of each pixel, ties go to the lower colour
+static unsigned char* majority(const uint32_t *hist, int h, int w) {
+    unsigned char *image = (unsigned char*)malloc((size_t)h * w);
+    if (image == NULL) return NULL;
+
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(static)
+#endif
+    for (size_t p = 0; p < (size_t)h * w; p++) {
+        const uint32_t *counts = hist + p * PYRAMID_COLOURS;
+        int best = 0;
+        for (int c = 1; c < PYRAMID_COLOURS; c++) {
+            if (counts[c] > counts[best]) best = c;
+        }
+        image[p] = (unsigned char)best;
+    }
+    return image;
+}
+
+static void write_index(const char *dir, int block, int origin_row, int origin_col, int rows, int cols,
+                        int first_level, int levels) {
+    char filename[512];
+    snprintf(filename, sizeof(filename), "%s/index_%d.txt", dir, block);
+    FILE *file = fopen(filename, "w");
+    if (!file) {
+        perror("Failed to open pyramid index for writing");
+        return;
+    }
+    fprintf(file, "block origin_row origin_col rows cols tile first_level levels\n");
+    fprintf(file, "%d %d %d %d %d %d %d %d\n", block, origin_row, origin_col, rows, cols, PYRAMID_TILE,
+            first_level, levels);
+    fclose(file);
+}
+
+static int make_dir(const char *dir) {
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+        perror("Failed to create pyramid directory");
+        return 1;
+    }
+    return 0;
+}
+
+// Writes the levels above level from its colour counts hist (h x w pixels),
+// until a level fits in one tile. Takes ownership of hist, returns the top level
+static int write_levels_above(const char *dir, int block, int level, uint32_t *hist, int h, int w) {
+    while (h > PYRAMID_TILE || w > PYRAMID_TILE) {
+        uint32_t *next = downsample(NULL, hist, h, w);
+        h = (h + 1) / 2;
+        w = (w + 1) / 2;
+        unsigned char *image = next ? majority(next, h, w) : NULL;
+        if (image == NULL) {
+            printf("Memory allocation failed for pyramid level %d\n", level + 1);
+            free(next);
+            break;
+        }
+        level++;
+        write_level(dir, block, level, image, h, w);
+        free(image);
+        free(hist);
+        hist = next;
+    }
+    free(hist);
+    return level;
+}
+
+void pyramid_write(const char *dir, int block, int origin_row, int origin_col,
+                   int rows, int cols, const unsigned char *colours) {
+    if (make_dir(dir)) return;
+
+    write_level(dir, block, 0, colours, rows, cols);
+    int level = 0;
+    if (rows > PYRAMID_TILE || cols > PYRAMID_TILE) {
+        uint32_t *hist = downsample(colours, NULL, rows, cols);
+        unsigned char *image = hist ? majority(hist, (rows + 1) / 2, (cols + 1) / 2) : NULL;
+        if (image == NULL) {
+            printf("Memory allocation failed for pyramid level 1\n");
+            free(hist);
+        } else {
+            level = 1;
+            write_level(dir, block, 1, image, (rows + 1) / 2, (cols + 1) / 2);
+            free(image);
+            level = write_levels_above(dir, block, 1, hist, (rows + 1) / 2, (cols + 1) / 2);
+        }
+    }
+    write_index(dir, block, origin_row, origin_col, rows, cols, 0, level + 1);
+}
+
+uint32_t* pyramid_write_block(const char *dir, int block, int origin_row, int origin_col,
+                              int rows, int cols, const unsigned char *colours, int split) {
+    if (make_dir(dir)) return NULL;
+
+    // Counts of level 0 are the colours themselves
+    uint32_t *hist = (uint32_t*)calloc((size_t)rows * cols * PYRAMID_COLOURS, sizeof(uint32_t));
+    if (hist == NULL) {
+        printf("Memory allocation failed for pyramid counts\n");
+        return NULL;
+    }
+    for (size_t p = 0; p < (size_t)rows * cols; p++) {
+        hist[p * PYRAMID_COLOURS + colour_index(colours[p])] = 1;
+    }
+    int h = rows, w = cols;
+    for (int level = 0; level < split && hist; level++) {
+        unsigned char *image = level == 0 ? (unsigned char*)colours : majority(hist, h, w);
+        if (image == NULL) {
+            printf("Memory allocation failed for pyramid level %d\n", level);
+            free(hist);
+            return NULL;
+        }
+        write_level(dir, block, level, image, h, w);
+        if (level > 0) free(image);
+        uint32_t *next = downsample(NULL, hist, h, w);
+        free(hist);
+        hist = next;
+        h = (h + 1) / 2;
+        w = (w + 1) / 2;
+    }
+    if (hist == NULL) {
+        printf("Memory allocation failed for pyramid counts\n");
+        return NULL;
+    }
+    write_index(dir, block, origin_row, origin_col, rows, cols, 0, split);
+    return hist;
+}
+
+void pyramid_write_counts(const char *dir, int block, int split, int rows, int cols, uint32_t *counts) {
+    if (make_dir(dir)) {
+        free(counts);
+        return;
+    }
+    int h = rows, w = cols;
+    for (int level = 0; level < split; level++) {
+        h = (h + 1) / 2;
+        w = (w + 1) / 2;
+    }
+    unsigned char *image = majority(counts, h, w);
+    if (image == NULL) {
+        printf("Memory allocation failed for pyramid level %d\n", split);
+        free(counts);
+        return;
+    }
+    write_level(dir, block, split, image, h, w);
+    free(image);
+    int top = write_levels_above(dir, block, split, counts, h, w);
+    write_index(dir, block, 0, 0, rows, cols, split, top - split + 1);
+}
@@ -2,53 +2,326 @@
 #include "../include/grid.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <stdbool.h>
 #include <time.h>
 
 double time_async = 0.0;
-#define THRESHOLD 4
+double time_sync = 0.0;
+long run_topples = 0;
 // Flag to indicate if any tile was unstable
 int stable = 0;
+// Number of topples in the current pass, recorded when pass_log is set
+long pass_topples = 0;
+// Cells of the current pass that were unstable when first swept, the blocked
+// kernel sweeps a block several times and can topple a cell more than once
+static long pass_unstable = 0;
+PassLog *pass_log = NULL;
+FrameWriter *frame_writer = NULL;
+int frame_every = 0;
+ProgressSlot *progress = NULL;
 
-void async_new_tile(int x, int y, Grid *grid) {
+// Elapsed time, not CPU time: the frame writer and progress threads would
+// otherwise be billed to the run, and threaded kernels to every thread
+double wall_time(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+// y indexes grid->layers, so in 3D it is z * layer_stride plus the row
+int async_new_tile(int x, int y, Grid *grid) {
     // Only one grid, update each surrounding block
-    if (grid->sandpile[y][x] >= THRESHOLD) {
-    int div4 = grid->sandpile[y][x] >> 2;  //div operation
-    // Update the surrounding tiles
-    grid->sandpile[y][x - 1] += div4; // Left
-    grid->sandpile[y][x + 1] += div4; // Right
-    grid->sandpile[y - 1][x] += div4; // Up
-    grid->sandpile[y + 1][x] += div4; // Down
+    unsigned long int **s = grid->layers;
+    if (s[y][x] >= THRESHOLD) {
+    unsigned long int share = LATTICE_SHARE(s[y][x]);  //shift on the square and Moore lattices
+    // Update the surrounding tiles, unrolled for the lattice
+    LATTICE_SCATTER(s[y - 1], s[y], s[y + 1], x, share, PLAIN_ADD);
+#if LATTICE_3D
+    LATTICE_ADD_Z(s[y - grid->layer_stride], s[y + grid->layer_stride], x, share, PLAIN_ADD);
+#endif
 
     // Remainder stays in the current tile
-    grid->sandpile[y][x] &= 3; // mod  
+    s[y][x] = LATTICE_KEEP(s[y][x]); // mask on the square and Moore lattices
 
     // Set flag to indicate at least one tile was unstable
     if (!stable) stable = 1; 
+    pass_topples++;
+    return 1;
     }
+    return 0;
 }
 
+// Counters of a finished pass for the progress sampler
+static void publish_progress(int pass, long topples, long unstable) {
+    if (!progress) return;
+    progress_add(&progress->topples, topples);
+    progress_set(&progress->unstable, unstable);
+    progress_set(&progress->pass, pass);
+}
 
-void topple_asynch(Grid *grid) {
+// Widen the column span of a row to include x_lo to x_hi, clipped to the grid
+static void span_include(int *lo, int *hi, int x_lo, int x_hi, int cols) {
+    if (x_lo < 1) x_lo = 1;
+    if (x_hi > cols) x_hi = cols;
+    if (x_lo < *lo) *lo = x_lo;
+    if (x_hi > *hi) *hi = x_hi;
+}
+
+int topple_asynch(Grid *grid) {
 
     // One grid
     int rows = grid->rows;
     int cols = grid->cols;
+    int stride = grid->layer_stride;
+    int first = GRID_FIRST_LAYER, last = GRID_LAST_LAYER(grid);
+    int total_rows = (last + 1) * stride;
 
-    clock_t start = clock();
+    // Per row column span of cells that may topple, for this pass and the
+    // next. A topple at (y, x) can make (y, x + 1), the row below and the
+    // layer below unstable later in the same pass, and (y, x - 1), the row
+    // above and the layer above in the next one, so only those spans grow.
+    // Cells outside the spans would not topple in a full sweep either, which
+    // keeps every pass identical to it.
+    int *lo = (int*)malloc(total_rows * sizeof(int));
+    int *hi = (int*)malloc(total_rows * sizeof(int));
+    int *next_lo = (int*)malloc(total_rows * sizeof(int));
+    int *next_hi = (int*)malloc(total_rows * sizeof(int));
+    if (!lo || !hi || !next_lo || !next_hi) {
+        printf("Memory allocation failed for the row spans\n");
+        free(lo); free(hi); free(next_lo); free(next_hi);
+        return -1;
+    }
+    for (int r = 0; r < total_rows; r++) {
+        lo[r] = 1;
+        hi[r] = cols;
+        next_lo[r] = cols + 1;
+        next_hi[r] = 0;
+    }
+
+    int pass = 0;
+    run_topples = 0;
+    double start = wall_time();
     while (true) {
         stable = 0; // Reset stable flag for each iteration
-        for (int y = 1; y <= rows; y++) {
-            for (int x = 1; x <= cols; x++) {
-                async_new_tile(x, y, grid);   
+        pass_topples = 0;
+        pass++;
+        if (progress) {
+            long active = 0;
+            for (int r = 0; r < total_rows; r++) {
+                if (hi[r] >= lo[r]) active += hi[r] - lo[r] + 1;
+            }
+            progress_set(&progress->active, active);
+        }
+        for (int z = first; z <= last; z++) {
+            for (int y = 1; y <= rows; y++) {
+                int r = z * stride + y;
+                // hi[r] may grow while the row is swept
+                for (int x = lo[r]; x <= hi[r]; x++) {
+                    if (async_new_tile(x, r, grid)) {
+                        if (x < cols && x + 1 > hi[r]) hi[r] = x + 1;
+                        if (y < rows) span_include(&lo[r + 1], &hi[r + 1], x + LATTICE_DOWN_LO, x + LATTICE_DOWN_HI, cols);
+                        if (x > 1) span_include(&next_lo[r], &next_hi[r], x - 1, x - 1, cols);
+                        if (y > 1) span_include(&next_lo[r - 1], &next_hi[r - 1], x + LATTICE_UP_LO, x + LATTICE_UP_HI, cols);
+                        if (LATTICE_3D && z < last) span_include(&lo[r + stride], &hi[r + stride], x, x, cols);
+                        if (LATTICE_3D && z > first) span_include(&next_lo[r - stride], &next_hi[r - stride], x, x, cols);
+                    }
+                }
             }
         }
+        run_topples += pass_topples;
+        if (pass_log) passlog_add(pass_log, pass_topples);
+        publish_progress(pass, pass_topples, pass_topples);
+        frames_capture(frame_writer, grid, frame_every, pass, stable == 0);
         if (stable == 0) {
             break; // If no tiles unstable, we are stable
         }
+        int *tmp = lo; lo = next_lo; next_lo = tmp;
+        tmp = hi; hi = next_hi; next_hi = tmp;
+        for (int r = 0; r < total_rows; r++) {
+            next_lo[r] = cols + 1;
+            next_hi[r] = 0;
+        }
     }
-    clock_t end = clock();
-    time_async = (double)(end - start) / CLOCKS_PER_SEC;
+    time_async = wall_time() - start;
+
+    free(lo);
+    free(hi);
+    free(next_lo);
+    free(next_hi);
+    return pass;
 }
 
     
+
+
+// A cell can only be unstable in the next pass if it toppled in this pass or
+// a neighbour did, so the next pass only needs the toppled box grown by one.
+static void grow_box(Box *box, const Box *toppled, int rows, int cols) {
+    box->top = toppled->top - 1 < 1 ? 1 : toppled->top - 1;
+    box->bottom = toppled->bottom + 1 > rows ? rows : toppled->bottom + 1;
+    box->left = toppled->left - 1 < 1 ? 1 : toppled->left - 1;
+    box->right = toppled->right + 1 > cols ? cols : toppled->right + 1;
+}
+
+// Sweep one block in place up to time_steps times, stopping early once it is
+// locally stable. Grains pushed over the block edge land straight in the
+// neighbouring block, so no halo copy is needed and the result is the same
+// as any other toppling order (abelian property). In 3D the block spans
+// every layer.
+// Cells toppled by the first sweep are added to pass_unstable.
+static int topple_block(Grid *grid, int y0, int y1, int x0, int x1, int time_steps, Box *toppled) {
+    int any_toppled = 0;
+
+    long before = pass_topples;
+    for (int t = 0; t < time_steps; t++) {
+        int changed = 0;
+        for (int z = GRID_FIRST_LAYER; z <= GRID_LAST_LAYER(grid); z++) {
+            unsigned long int **s = grid->layers + (size_t)z * grid->layer_stride;
+            for (int y = y0; y < y1; y++) {
+                for (int x = x0; x < x1; x++) {
+                    if (s[y][x] >= THRESHOLD) {
+                        unsigned long int share = LATTICE_SHARE(s[y][x]);
+                        LATTICE_SCATTER(s[y - 1], s[y], s[y + 1], x, share, PLAIN_ADD);
+#if LATTICE_3D
+                        LATTICE_ADD_Z(s[y - grid->layer_stride], s[y + grid->layer_stride], x, share, PLAIN_ADD);
+#endif
+                        s[y][x] = LATTICE_KEEP(s[y][x]);
+                        if (y < toppled->top) toppled->top = y;
+                        if (y > toppled->bottom) toppled->bottom = y;
+                        if (x < toppled->left) toppled->left = x;
+                        if (x > toppled->right) toppled->right = x;
+                        changed = 1;
+                        pass_topples++;
+                    }
+                }
+            }
+        }
+        if (!changed) break;
+        if (t == 0) pass_unstable += pass_topples - before;
+        any_toppled = 1;
+    }
+    return any_toppled;
+}
+
+// Temporally blocked version of topple_asynch: each block_size x block_size
+// block is advanced several sweeps while it is cache resident before the
+// sweep moves on to the next block. Blocks are clipped to the bounding box of
+// cells that may be unstable.
+int topple_blocked(Grid *grid, int block_size, int time_steps) {
+    int rows = grid->rows;
+    int cols = grid->cols;
+    Box box = {1, rows, 1, cols};
+
+    int pass = 0;
+    run_topples = 0;
+    double start = wall_time();
+    while (true) {
+        stable = 0;
+        pass_topples = 0;
+        pass_unstable = 0;
+        pass++;
+        Box toppled = {rows + 1, 0, cols + 1, 0};
+        if (progress) {
+            long layers = GRID_LAST_LAYER(grid) - GRID_FIRST_LAYER + 1;
+            progress_set(&progress->active, layers * (box.bottom - box.top + 1) * (box.right - box.left + 1));
+        }
+        for (int y0 = box.top; y0 <= box.bottom; y0 += block_size) {
+            int y1 = y0 + block_size > box.bottom + 1 ? box.bottom + 1 : y0 + block_size;
+            for (int x0 = box.left; x0 <= box.right; x0 += block_size) {
+                int x1 = x0 + block_size > box.right + 1 ? box.right + 1 : x0 + block_size;
+                if (topple_block(grid, y0, y1, x0, x1, time_steps, &toppled)) stable = 1;
+            }
+        }
+        run_topples += pass_topples;
+        if (pass_log) passlog_add(pass_log, pass_topples);
+        publish_progress(pass, pass_topples, pass_unstable);
+        frames_capture(frame_writer, grid, frame_every, pass, stable == 0);
+        if (stable == 0) {
+            break;
+        }
+        grow_box(&box, &toppled, rows, cols);
+    }
+    time_async = wall_time() - start;
+    return pass;
+}
+
+// Point the rows of every layer at grid->cells again after it was swapped
+static void relink_rows(Grid *grid, int total_rows) {
+    for (int r = 0; r < total_rows; r++) {
+        grid->layers[r] = grid->cells + (size_t)r * (grid->cols + 2);
+    }
+}
+
+// Synchronous (Jacobi) passes: every cell of the next state is computed from
+// the current one into a second buffer, so a pass has no order dependence,
+// rows are shared between OpenMP threads and the row kernel is vectorised.
+// It takes more passes than topple_asynch but reaches the same stable grid
+// (abelian property). Only cells that changed in a pass can be unstable in
+// the next, so passes sweep the band of rows two away from the last
+// unstable ones, across every layer in 3D.
+int topple_synch(Grid *grid, SimdLevel level) {
+    int rows = grid->rows;
+    int cols = grid->cols;
+    int stride = grid->layer_stride;
+    int first = GRID_FIRST_LAYER, layers = GRID_LAST_LAYER(grid) - first + 1;
+    int total_rows = GRID_LAYERS(grid->depth) * stride;
+    size_t row_cells = cols + 2;
+    SynchRowKernel kernel = synch_row_kernel(level);
+
+    // Ghost cells are copied once and never written
+    unsigned long int *next = (unsigned long int*)malloc(grid->capacity * sizeof(unsigned long int));
+    if (next == NULL) {
+        printf("Memory allocation failed for the next grid\n");
+        return -1;
+    }
+    memcpy(next, grid->cells, total_rows * row_cells * sizeof(unsigned long int));
+
+    int top = 1, bottom = rows;
+    int pass = 0;
+    run_topples = 0;
+    double start = wall_time();
+    while (true) {
+        pass++;
+        int band = bottom - top + 1;
+        if (progress) progress_set(&progress->active, (long)layers * band * cols);
+        long unstable = 0;
+        int hot_top = rows + 1, hot_bottom = 0;
+        const unsigned long int *in = grid->cells;
+        #pragma omp parallel for schedule(static) reduction(+:unstable) reduction(min:hot_top) reduction(max:hot_bottom)
+        for (int k = 0; k < layers * band; k++) {
+            int y = top + k % band;
+            size_t offset = ((size_t)(first + k / band) * stride + y) * row_cells;
+            const unsigned long int *row = in + offset;
+            long hot = kernel(row - row_cells, row, row + row_cells,
+                              LATTICE_3D ? row - stride * row_cells : NULL,
+                              LATTICE_3D ? row + stride * row_cells : NULL, next + offset, cols);
+            if (hot) {
+                unstable += hot;
+                if (y < hot_top) hot_top = y;
+                if (y > hot_bottom) hot_bottom = y;
+            }
+        }
+        // With nothing unstable the output equals the input, keep the input
+        if (unstable > 0) {
+            unsigned long int *tmp = grid->cells; grid->cells = next; next = tmp;
+            relink_rows(grid, total_rows);
+        }
+        run_topples += unstable;
+        if (pass_log) passlog_add(pass_log, unstable);
+        publish_progress(pass, unstable, unstable);
+        frames_capture(frame_writer, grid, frame_every, pass, unstable == 0);
+        if (unstable == 0) {
+            break;
+        }
+        // Rows that changed are one away from the unstable ones, the next
+        // unstable rows are among those, and the output buffer is stale
+        // only there. Sweep one more row either side.
+        top = hot_top - 2 < 1 ? 1 : hot_top - 2;
+        bottom = hot_bottom + 2 > rows ? rows : hot_bottom + 2;
+    }
+    time_sync = wall_time() - start;
+
+    free(next);
+    return pass;
+}
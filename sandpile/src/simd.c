@@ -0,0 +1,148 @@
+// Row kernels of the synchronous engine
+// Each cell of the next state is a pure function of the current state around
+// it, so whole vectors of cells are updated at once. The vector kernels are
+// compiled for their instruction set with target attributes and only called
+// after the CPU has been checked, the rest of the build stays generic.
+
+#include <string.h>
+#include "../include/simd.h"
+#include "../include/lattice.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && \
+    (defined(LATTICE_SQUARE) || defined(LATTICE_MOORE))
+#define SIMD_X86 1
+#include <immintrin.h>
+#else
+#define SIMD_X86 0
+#endif
+
+static const char *level_names[NUM_SIMD_LEVELS] = {"scalar", "avx2", "avx512"};
+
+// Cells j0 to cols of the row. A neighbour whose scatter reaches column j
+// lies in the row above at j - DOWN_HI to j - DOWN_LO and in the row below
+// at j - UP_HI to j - UP_LO, the constant bounds unroll
+static long synch_cells(const unsigned long int *up, const unsigned long int *row,
+                        const unsigned long int *down, const unsigned long int *below,
+                        const unsigned long int *above, unsigned long int *out, int j0, int cols) {
+    long unstable = 0;
+    for (int j = j0; j <= cols; j++) {
+        unsigned long int value = row[j];
+        unsigned long int sum = LATTICE_KEEP(value) + LATTICE_SHARE(row[j - 1]) + LATTICE_SHARE(row[j + 1]);
+        for (int k = j - LATTICE_DOWN_HI; k <= j - LATTICE_DOWN_LO; k++) sum += LATTICE_SHARE(up[k]);
+        for (int k = j - LATTICE_UP_HI; k <= j - LATTICE_UP_LO; k++) sum += LATTICE_SHARE(down[k]);
+#if LATTICE_3D
+        sum += LATTICE_SHARE(below[j]) + LATTICE_SHARE(above[j]);
+#else
+        (void)below;
+        (void)above;
+#endif
+        out[j] = sum;
+        unstable += value >= THRESHOLD;
+    }
+    return unstable;
+}
+
+static long synch_row_scalar(const unsigned long int *up, const unsigned long int *row,
+                             const unsigned long int *down, const unsigned long int *below,
+                             const unsigned long int *above, unsigned long int *out, int cols) {
+    return synch_cells(up, row, down, below, above, out, 1, cols);
+}
+
+#if SIMD_X86
+
+#ifdef LATTICE_MOORE
+#define SHARE_SHIFT 3
+#else
+#define SHARE_SHIFT 2
+#endif
+
+// Cells are 64 bit and far below 2^63, so the signed compare is safe
+__attribute__((target("avx2")))
+static long synch_row_avx2(const unsigned long int *up, const unsigned long int *row,
+                           const unsigned long int *down, const unsigned long int *below,
+                           const unsigned long int *above, unsigned long int *out, int cols) {
+    const __m256i keep = _mm256_set1_epi64x(THRESHOLD - 1);
+#define LOAD4(p) _mm256_srli_epi64(_mm256_loadu_si256((const __m256i*)(p)), SHARE_SHIFT)
+    long unstable = 0;
+    int j = 1;
+    for (; j + 3 <= cols; j += 4) {
+        __m256i value = _mm256_loadu_si256((const __m256i*)(row + j));
+        __m256i sum = _mm256_and_si256(value, keep);
+        sum = _mm256_add_epi64(sum, _mm256_add_epi64(LOAD4(row + j - 1), LOAD4(row + j + 1)));
+        sum = _mm256_add_epi64(sum, _mm256_add_epi64(LOAD4(up + j), LOAD4(down + j)));
+#ifdef LATTICE_MOORE
+        sum = _mm256_add_epi64(sum, _mm256_add_epi64(LOAD4(up + j - 1), LOAD4(up + j + 1)));
+        sum = _mm256_add_epi64(sum, _mm256_add_epi64(LOAD4(down + j - 1), LOAD4(down + j + 1)));
+#endif
+        _mm256_storeu_si256((__m256i*)(out + j), sum);
+        __m256i hot = _mm256_cmpgt_epi64(value, keep);
+        unstable += __builtin_popcount(_mm256_movemask_pd(_mm256_castsi256_pd(hot)));
+    }
+#undef LOAD4
+    return unstable + synch_cells(up, row, down, below, above, out, j, cols);
+}
+
+__attribute__((target("avx512f")))
+static long synch_row_avx512(const unsigned long int *up, const unsigned long int *row,
+                             const unsigned long int *down, const unsigned long int *below,
+                             const unsigned long int *above, unsigned long int *out, int cols) {
+    const __m512i keep = _mm512_set1_epi64(THRESHOLD - 1);
+#define LOAD8(p) _mm512_srli_epi64(_mm512_loadu_si512((const void*)(p)), SHARE_SHIFT)
+    long unstable = 0;
+    int j = 1;
+    for (; j + 7 <= cols; j += 8) {
+        __m512i value = _mm512_loadu_si512((const void*)(row + j));
+        __m512i sum = _mm512_and_si512(value, keep);
+        sum = _mm512_add_epi64(sum, _mm512_add_epi64(LOAD8(row + j - 1), LOAD8(row + j + 1)));
+        sum = _mm512_add_epi64(sum, _mm512_add_epi64(LOAD8(up + j), LOAD8(down + j)));
+#ifdef LATTICE_MOORE
+        sum = _mm512_add_epi64(sum, _mm512_add_epi64(LOAD8(up + j - 1), LOAD8(up + j + 1)));
+        sum = _mm512_add_epi64(sum, _mm512_add_epi64(LOAD8(down + j - 1), LOAD8(down + j + 1)));
+#endif
+        _mm512_storeu_si512((void*)(out + j), sum);
+        unstable += __builtin_popcount(_mm512_cmpgt_epu64_mask(value, keep));
+    }
+#undef LOAD8
+    return unstable + synch_cells(up, row, down, below, above, out, j, cols);
+}
+
+#endif
+
+SimdLevel simd_detect(void) {
+#if SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return SIMD_AVX512;
+    if (__builtin_cpu_supports("avx2")) return SIMD_AVX2;
+#endif
+    return SIMD_SCALAR;
+}
+
+const char* simd_name(SimdLevel level) {
+    return level >= 0 && level < NUM_SIMD_LEVELS ? level_names[level] : "?";
+}
+
+int simd_parse(const char *name, SimdLevel *level) {
+    for (int l = 0; l < NUM_SIMD_LEVELS; l++) {
+        if (strcmp(name, level_names[l]) == 0) {
+            *level = (SimdLevel)l;
+            return 0;
+        }
+    }
+    return 1;
+}
+
+SynchRowKernel synch_row_kernel(SimdLevel level) {
+    if (level > simd_detect()) return NULL;
+    switch (level) {
+#if SIMD_X86
+    case SIMD_AVX2:
+        return synch_row_avx2;
+    case SIMD_AVX512:
+        return synch_row_avx512;
+#endif
+    case SIMD_SCALAR:
+        return synch_row_scalar;
+    default:
+        return NULL;
+    }
+}
@@ -0,0 +1,408 @@
+// OpenMP engines on the shared Grid
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <sched.h>
+#include <omp.h>
+#include "../include/tiled.h"
+#include "../include/sandpile.h"
+#include "../include/lattice.h"
+
+#if !LATTICE_3D
+
+long process_tile(Grid *grid, int tile_row, int tile_col, int tile_size, int *sweeps, long *unstable) {
+    unsigned long int **s = grid->sandpile;
+    int start_row = tile_row * tile_size + 1;
+    int end_row = start_row + tile_size;
+    if (end_row > grid->rows + 1) end_row = grid->rows + 1;
+
+    int start_col = tile_col * tile_size + 1;
+    int end_col = start_col + tile_size;
+    if (end_col > grid->cols + 1) end_col = grid->cols + 1;
+
+    int changed = 1;
+    long toppled = 0;
+    int passes = 0;
+
+    // Keep processing until no more changes in this tile
+    while (changed) {
+        changed = 0;
+        passes++;
+
+        // Process cells in cache-friendly order
+        for (int i = start_row; i < end_row; i++) {
+            for (int j = start_col; j < end_col; j++) {
+                if (s[i][j] >= THRESHOLD) {
+                    toppled++;
+
+                    unsigned long int dist = LATTICE_SHARE(s[i][j]);  // division by 4 on the square lattice
+                    s[i][j] = LATTICE_KEEP(s[i][j]);  // modulo 4
+
+                    // Use atomic operations for boundary updates
+                    LATTICE_SCATTER(s[i-1], s[i], s[i+1], j, dist, ATOMIC_ADD);
+
+                    changed = 1;
+                }
+            }
+        }
+        if (passes == 1 && unstable) *unstable = toppled;
+    }
+    if (sweeps) *sweeps = passes;
+    return toppled;
+}
+
+// Grains moving between tiles inside the block are absorbed here instead of
+// waiting for the next global red/black phase. With one tile and one round
+// this is process_tile.
+long process_block(Grid *grid, int block_row, int block_col, int tile_size, int tiles_per_block, int time_steps,
+                   long *unstable) {
+    int tiles_rows = (grid->rows + tile_size - 1) / tile_size;
+    int tiles_cols = (grid->cols + tile_size - 1) / tile_size;
+
+    int first_row = block_row * tiles_per_block;
+    int last_row = first_row + tiles_per_block;
+    if (last_row > tiles_rows) last_row = tiles_rows;
+
+    int first_col = block_col * tiles_per_block;
+    int last_col = first_col + tiles_per_block;
+    if (last_col > tiles_cols) last_col = tiles_cols;
+
+    long toppled = 0;
+    *unstable = 0;
+    for (int step = 0; step < time_steps; step++) {
+        long changed = 0;
+        for (int tr = first_row; tr < last_row; tr++) {
+            for (int tc = first_col; tc < last_col; tc++) {
+                long tile_unstable = 0;
+                changed += process_tile(grid, tr, tc, tile_size, NULL, &tile_unstable);
+                if (step == 0) *unstable += tile_unstable;
+            }
+        }
+        if (!changed) break;
+        toppled += changed;
+    }
+    return toppled;
+}
+
+// Lattices with diagonal neighbours let diagonally adjacent tiles write each
+// other's corners, so they need four colours (2x2 classes) instead of two
+#define TILE_COLOURS (LATTICE_DIAGONAL ? 4 : 2)
+
+static int tile_colour(int tile_row, int tile_col) {
+    return LATTICE_DIAGONAL ? (tile_row % 2) * 2 + tile_col % 2 : (tile_row + tile_col) % 2;
+}
+
+// Optimized red-black tiling with better scheduling
+// Colouring is done per block of tiles_per_block x tiles_per_block tiles, blocks
+// of the same colour never share a cell so they can run concurrently.
+// Frames are captured and the topples of each iteration go to the pass log
+// when the run has them. Each thread publishes its topples to its own
+// progress slot, slot 0 also carries the iteration and the active box.
+// Returns the number of iterations, topples gets their topples
+static int parallel_sandpile(EngineRun *run, int tiles_per_block, int time_steps, long *topples) {
+    Grid *grid = run->grid;
+    int rows = grid->rows;
+    int cols = grid->cols;
+    ProgressMonitor *progress = run->progress;
+    int num_threads = omp_get_max_threads() - 6;
+
+    // Smaller tiles for better load balancing
+    int tile_size = TILE_SIZE;
+    int block_size = tile_size * tiles_per_block;
+    // Tile indices below count blocks, a block is a single tile when unblocked
+    int tiles_rows = (rows + block_size - 1) / block_size;
+    int tiles_cols = (cols + block_size - 1) / block_size;
+
+    printf("Using %d threads \n", num_threads);
+
+    int global_changed = 1;
+    int iteration = 0;
+    *topples = 0;
+
+    // Tile index lists per colour (red, black, ...), rebuilt each iteration
+    // from the active box
+    int total_tiles = tiles_rows * tiles_cols;
+    int* colour_tiles[TILE_COLOURS];
+    int colour_count[TILE_COLOURS];
+    for (int c = 0; c < TILE_COLOURS; c++) {
+        colour_tiles[c] = (int*)malloc(total_tiles * sizeof(int));
+    }
+
+    // Bounding box (in tiles) of tiles that may hold unstable cells
+    int box_top = 0, box_bottom = tiles_rows - 1;
+    int box_left = 0, box_right = tiles_cols - 1;
+
+    while (global_changed) {
+        global_changed = 0;
+        iteration++;
+
+        if (progress) {
+            int box_rows = ((box_bottom + 1) * block_size > rows ? rows : (box_bottom + 1) * block_size) - box_top * block_size;
+            int box_cols = ((box_right + 1) * block_size > cols ? cols : (box_right + 1) * block_size) - box_left * block_size;
+            progress_set(&progress_slot(progress, 0)->active, (long)box_rows * box_cols);
+            for (int t = 0; t < omp_get_max_threads(); t++) {
+                progress_set(&progress_slot(progress, t)->unstable, 0);
+            }
+        }
+
+        for (int c = 0; c < TILE_COLOURS; c++) colour_count[c] = 0;
+        for (int tile_row = box_top; tile_row <= box_bottom; tile_row++) {
+            for (int tile_col = box_left; tile_col <= box_right; tile_col++) {
+                int colour = tile_colour(tile_row, tile_col);
+                colour_tiles[colour][colour_count[colour]++] = tile_row * tiles_cols + tile_col;
+            }
+        }
+
+        // Tiles that toppled this iteration
+        long iteration_topples = 0;
+        int next_top = tiles_rows, next_bottom = -1;
+        int next_left = tiles_cols, next_right = -1;
+
+        // Process one colour at a time, red then black on the square lattice
+        for (int c = 0; c < TILE_COLOURS; c++) {
+            int* tiles = colour_tiles[c];
+            int count = colour_count[c];
+
+            #pragma omp parallel reduction(||:global_changed) reduction(+:iteration_topples) \
+                reduction(min:next_top,next_left) reduction(max:next_bottom,next_right)
+            {
+                int local_changed = 0;
+                long local_topples = 0, local_unstable = 0;
+
+                #pragma omp for schedule(guided, 2) nowait
+                for (int i = 0; i < count; i++) {
+                    int tile_idx = tiles[i];
+                    int tile_row = tile_idx / tiles_cols;
+                    int tile_col = tile_idx % tiles_cols;
+
+                    long unstable;
+                    long block_topples = process_block(grid, tile_row, tile_col, tile_size, tiles_per_block,
+                                                       time_steps, &unstable);
+                    if (block_topples) {
+                        local_changed = 1;
+                        local_topples += block_topples;
+                        local_unstable += unstable;
+                        if (tile_row < next_top) next_top = tile_row;
+                        if (tile_row > next_bottom) next_bottom = tile_row;
+                        if (tile_col < next_left) next_left = tile_col;
+                        if (tile_col > next_right) next_right = tile_col;
+                    }
+                }
+
+                if (local_changed) global_changed = 1;
+                iteration_topples += local_topples;
+                if (progress && local_topples) {
+                    ProgressSlot *slot = progress_slot(progress, omp_get_thread_num());
+                    progress_add(&slot->topples, local_topples);
+                    progress_add(&slot->unstable, local_unstable);
+                }
+            }
+
+            // Implicit barrier here
+        }
+
+        // Toppled tiles spill into their neighbours, grow the box by one tile
+        box_top = next_top - 1 < 0 ? 0 : next_top - 1;
+        box_bottom = next_bottom + 1 >= tiles_rows ? tiles_rows - 1 : next_bottom + 1;
+        box_left = next_left - 1 < 0 ? 0 : next_left - 1;
+        box_right = next_right + 1 >= tiles_cols ? tiles_cols - 1 : next_right + 1;
+        *topples += iteration_topples;
+        if (progress) progress_set(&progress_slot(progress, 0)->pass, iteration);
+        if (run->pass_log) passlog_add(run->pass_log, iteration_topples);
+        frames_capture(run->frames, run->grid, run->opts->frame_every, iteration, !global_changed);
+    }
+
+    printf("Sandpile stabilized after %d iterations\n", iteration - 1);
+
+    for (int c = 0; c < TILE_COLOURS; c++) {
+        free(colour_tiles[c]);
+    }
+    return iteration;
+}
+
+static int run_tiled(EngineRun *run, EngineStats *stats) {
+    // Unblocked run is the original one tile, one round schedule
+    int tiles_per_block = 1;
+    int time_steps = 1;
+    if (run->opts->blocked) {
+        tiles_per_block = (run->opts->block_size + TILE_SIZE - 1) / TILE_SIZE;
+        time_steps = run->opts->time_steps;
+    }
+    double start = wall_time();
+    stats->passes = parallel_sandpile(run, tiles_per_block, time_steps, &stats->topples);
+    stats->seconds = wall_time() - start;
+    stats->threads = omp_get_max_threads();
+    return 0;
+}
+
+// Topple every unstable cell of row i left to right, exactly as topple_asynch
+// does. Adds into a row that another band also writes must be atomic.
+static long wavefront_row(unsigned long int **s, int i, int cols, int atomic_up, int atomic_down) {
+    long topples = 0;
+    for (int j = 1; j <= cols; j++) {
+        if (s[i][j] >= THRESHOLD) {
+            unsigned long int dist = LATTICE_SHARE(s[i][j]);
+            LATTICE_ADD_ROW(s[i], j, dist, PLAIN_ADD);
+            if (atomic_up) {
+                LATTICE_ADD_UP(s[i-1], j, dist, ATOMIC_ADD);
+            } else {
+                LATTICE_ADD_UP(s[i-1], j, dist, PLAIN_ADD);
+            }
+            if (atomic_down) {
+                LATTICE_ADD_DOWN(s[i+1], j, dist, ATOMIC_ADD);
+            } else {
+                LATTICE_ADD_DOWN(s[i+1], j, dist, PLAIN_ADD);
+            }
+            s[i][j] = LATTICE_KEEP(s[i][j]);
+            topples++;
+        }
+    }
+    return topples;
+}
+
+// Spins before a waiting band gives up its core, a neighbouring band
+// normally finishes its row well within this
+#define WAIT_SPINS 4096
+
+// Tell the core we are spinning, so an SMT sibling gets the issue slots
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+// Block until *counter reaches target or the run has been stopped. Spins
+// briefly, then yields so oversubscribed bands let the one they wait on run
+static void wait_for(atomic_int *counter, int target, atomic_int *stop_pass) {
+    for (int spins = 0; atomic_load_explicit(counter, memory_order_acquire) < target; spins++) {
+        if (atomic_load_explicit(stop_pass, memory_order_acquire)) return;
+        if (spins < WAIT_SPINS) {
+            cpu_relax();
+        } else {
+            sched_yield();
+        }
+    }
+}
+
+// Pipelined row-band wavefront with the same in-place row-major update order
+// as the serial topple_asynch. Thread k owns band k and runs one sweep behind
+// thread k-1: row i may start pass p once row i-1 has finished pass p and row
+// i+1 has finished pass p-1, which only needs waiting at band edges. Every
+// pass leaves the grid in the same state as the serial pass, so per pass
+// topple counts in log can be diffed against the serial reference. Band k
+// publishes its passes and topples to progress slot k. Returns the number of
+// passes, topples gets their topples and bands the number of row bands
+static int wavefront_sandpile(Grid *grid, PassLog *log, ProgressMonitor *progress, long *topples, int *bands) {
+    unsigned long int **s = grid->sandpile;
+    int rows = grid->rows;
+    int cols = grid->cols;
+    int num_bands = 1;
+    atomic_int *row_done = NULL;
+    long *band_topples = NULL;
+    int ring = 0;
+    atomic_int stop_pass;
+    atomic_init(&stop_pass, 0);
+    long run_total = 0; // Only written by the last band
+
+    #pragma omp parallel
+    {
+        // Every band must have a thread or its neighbours wait forever, so the
+        // bands are counted from the threads the region actually got
+        #pragma omp single
+        {
+            num_bands = omp_get_num_threads();
+            if (num_bands > rows) num_bands = rows;
+            if (num_bands < 1) num_bands = 1;
+            printf("Using %d row bands \n", num_bands);
+
+            // Passes completed by each row, rows 0 and rows + 1 are never waited on
+            row_done = (atomic_int*)malloc((rows + 2) * sizeof(atomic_int));
+            for (int i = 0; i < rows + 2; i++) atomic_init(&row_done[i], 0);
+
+            // Topples per band per pass. Each band can run at most two passes
+            // ahead of the band below it, so a ring of 2 * num_bands + 2 passes
+            // is never overwritten before the last band has summed it
+            ring = 2 * num_bands + 2;
+            band_topples = (long*)calloc(num_bands * ring, sizeof(long));
+        }
+
+        int band = omp_get_thread_num();
+        if (band < num_bands) {
+            int first = 1 + (int)((long)rows * band / num_bands);
+            int last = (int)((long)rows * (band + 1) / num_bands);
+            ProgressSlot *slot = progress_slot(progress, band);
+            if (slot) progress_set(&slot->active, (long)(last - first + 1) * cols);
+
+            for (int pass = 1; ; pass++) {
+                int stop = atomic_load_explicit(&stop_pass, memory_order_acquire);
+                if (stop && pass > stop) break;
+
+                long pass_topples = 0;
+                for (int i = first; i <= last; i++) {
+                    if (i == first && i > 1) wait_for(&row_done[i - 1], pass, &stop_pass);
+                    if (i == last && i < rows) wait_for(&row_done[i + 1], pass - 1, &stop_pass);
+
+                    // Edge rows of a band are shared with the neighbouring band
+                    int atomic_up = (i - 1 == first || i == first) && i > 1;
+                    int atomic_down = (i + 1 == last || i == last) && i < rows;
+                    pass_topples += wavefront_row(s, i, cols, atomic_up, atomic_down);
+
+                    if (i == last) band_topples[band * ring + pass % ring] = pass_topples;
+                    atomic_store_explicit(&row_done[i], pass, memory_order_release);
+                }
+                if (slot) {
+                    progress_add(&slot->topples, pass_topples);
+                    progress_set(&slot->unstable, pass_topples);
+                    progress_set(&slot->pass, pass);
+                }
+
+                // All other bands finished this pass before the last band did
+                if (band == num_bands - 1) {
+                    long total = 0;
+                    for (int b = 0; b < num_bands; b++) {
+                        total += band_topples[b * ring + pass % ring];
+                    }
+                    run_total += total;
+                    if (log) passlog_add(log, total);
+                    if (total == 0) {
+                        atomic_store_explicit(&stop_pass, pass, memory_order_release);
+                    }
+                }
+            }
+        }
+    }
+
+    int passes = atomic_load(&stop_pass);
+    printf("Sandpile stabilized after %d iterations\n", passes - 1);
+    *topples = run_total;
+    *bands = num_bands;
+
+    free(row_done);
+    free(band_topples);
+    return passes;
+}
+
+// The wavefront has no point where every band is on the same pass, so it
+// captures no frames
+static int run_wavefront(EngineRun *run, EngineStats *stats) {
+    double start = wall_time();
+    stats->passes = wavefront_sandpile(run->grid, run->pass_log, run->progress, &stats->topples, &stats->threads);
+    stats->seconds = wall_time() - start;
+    return 0;
+}
+
+const Engine openmp_engine = {
+    "openmp", "OpemMP", "OpenMPBlocked", NULL, "red-black tiles shared by OpenMP threads, --blocked for blocks of tiles",
+    "output_openmp.ppm", ENGINE_THREADED | ENGINE_BLOCKED | ENGINE_PASS_LOG | ENGINE_FRAMES, NULL, NULL, run_tiled,
+};
+
+const Engine wavefront_engine = {
+    "wavefront", "OpenMPWavefront", NULL, NULL, "OpenMP row bands in the serial sweep order, same passes as asynch",
+    "output_openmp.ppm", ENGINE_THREADED | ENGINE_PASS_LOG, NULL, NULL, run_wavefront,
+};
+
+#endif
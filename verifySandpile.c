@@ -0,0 +1,155 @@
+// Cross-check runs of the serial, OpenMP and MPI versions.
+// Given a checksums csv it flags runs of the same configuration whose final
+// grids differ. Given two grid files written with --save it locates the first
+// differing tile and cell.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "sandpile/include/checksum.h"
+#include "sandpile/include/initial.h"
+
+#define DEFAULT_TILE 64
+
+typedef struct Run {
+    char version[64];
+    int threads, rows, cols;
+    unsigned long int centre, allVal;
+    uint64_t init;
+    GridChecksum sum;
+    int line;
+} Run;
+
+static int same_config(const Run *a, const Run *b) {
+    return a->rows == b->rows && a->cols == b->cols && a->centre == b->centre &&
+           a->allVal == b->allVal && a->init == b->init;
+}
+
+// Every run is compared with the first run of its configuration
+static int verify_checksums(const char *filename) {
+    FILE *file = fopen(filename, "r");
+    if (!file) {
+        perror("Failed to open checksums file");
+        return 2;
+    }
+
+    int count = 0, capacity = 256;
+    Run *runs = (Run*)malloc(capacity * sizeof(Run));
+    char line[512];
+    int line_number = 0;
+    while (fgets(line, sizeof(line), file)) {
+        line_number++;
+        if (count == capacity) {
+            capacity *= 2;
+            runs = (Run*)realloc(runs, capacity * sizeof(Run));
+        }
+        Run *run = &runs[count];
+        if (checksums_parse(line, run->version, sizeof(run->version), &run->threads, &run->rows,
+                            &run->cols, &run->centre, &run->allVal, &run->init, &run->sum)) {
+            fprintf(stderr, "%s:%d: skipping malformed line\n", filename, line_number);
+            continue;
+        }
+        run->line = line_number;
+        count++;
+    }
+    fclose(file);
+
+    int configs = 0, mismatches = 0;
+    for (int r = 0; r < count; r++) {
+        int first = 0;
+        while (!same_config(&runs[first], &runs[r])) first++;
+        if (first == r) {
+            configs++;
+            continue;
+        }
+        if (!checksum_equal(&runs[first].sum, &runs[r].sum)) {
+            mismatches++;
+            printf("MISMATCH %dx%d centre %lu all %lu init %016" PRIx64 ": %s x%d (line %d) differs from %s x%d (line %d)\n",
+                   runs[r].rows, runs[r].cols, runs[r].centre, runs[r].allVal, runs[r].init,
+                   runs[r].version, runs[r].threads, runs[r].line,
+                   runs[first].version, runs[first].threads, runs[first].line);
+            printf("  %-16s ", runs[first].version);
+            checksum_print(&runs[first].sum);
+            printf("  %-16s ", runs[r].version);
+            checksum_print(&runs[r].sum);
+        }
+    }
+    printf("%d runs of %d configurations, %d mismatches\n", count, configs, mismatches);
+    free(runs);
+    return mismatches != 0;
+}
+
+static int map_grid(const char *filename, InitialCondition *grid) {
+    initial_default(grid);
+    grid->kind = INIT_FILE;
+    grid->file = filename;
+    return initial_open(grid);
+}
+
+static void print_grid_checksum(const char *filename, const InitialCondition *grid) {
+    GridChecksum sum;
+    checksum_clear(&sum);
+    for (size_t i = 0; i < (size_t)grid->rows * grid->cols; i++) {
+        uint32_t value = grid->cells[i];
+        sum.hash += checksum_cell(i, value);
+        sum.grains += value;
+        sum.histogram[value < CHECKSUM_BINS - 1 ? value : CHECKSUM_BINS - 1]++;
+    }
+    printf("%s: %dx%d\n  ", filename, grid->rows, grid->cols);
+    checksum_print(&sum);
+}
+
+// Tiles are visited in row-major order, the first differing one is reported
+// with its first differing cell
+static int verify_grids(const char *file_a, const char *file_b, int tile) {
+    InitialCondition a, b;
+    if (map_grid(file_a, &a) || map_grid(file_b, &b)) return 2;
+    print_grid_checksum(file_a, &a);
+    print_grid_checksum(file_b, &b);
+    if (a.rows != b.rows || a.cols != b.cols) {
+        printf("MISMATCH grid sizes differ\n");
+        return 1;
+    }
+
+    int rows = a.rows, cols = a.cols;
+    int tiles_rows = (rows + tile - 1) / tile;
+    int tiles_cols = (cols + tile - 1) / tile;
+    long differing = 0;
+    for (int ty = 0; ty < tiles_rows; ty++) {
+        for (int tx = 0; tx < tiles_cols; tx++) {
+            int r0 = ty * tile, r1 = r0 + tile > rows ? rows : r0 + tile;
+            int c0 = tx * tile, c1 = c0 + tile > cols ? cols : c0 + tile;
+            for (int i = r0; i < r1; i++) {
+                size_t offset = (size_t)i * cols + c0;
+                if (memcmp(a.cells + offset, b.cells + offset, (c1 - c0) * sizeof(uint32_t)) == 0) continue;
+
+                if (differing == 0) {
+                    int j = c0;
+                    while (a.cells[offset + j - c0] == b.cells[offset + j - c0]) j++;
+                    printf("MISMATCH first differing tile %d,%d (rows %d-%d, cols %d-%d), "
+                           "cell %d,%d is %u vs %u\n", ty, tx, r0, r1 - 1, c0, c1 - 1, i, j,
+                           a.cells[offset + j - c0], b.cells[offset + j - c0]);
+                }
+                differing++;
+                break;
+            }
+        }
+    }
+    printf("%ld of %d tiles of %dx%d differ\n", differing, tiles_rows * tiles_cols, tile, tile);
+    initial_close(&a);
+    initial_close(&b);
+    return differing != 0;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc == 2) {
+        return verify_checksums(argv[1]);
+    }
+    if (argc == 3 || argc == 4) {
+        int tile = argc == 4 ? atoi(argv[3]) : DEFAULT_TILE;
+        if (tile > 0) return verify_grids(argv[1], argv[2], tile);
+    }
+    fprintf(stderr, "Usage: %s checksums.csv\n", argv[0]);
+    fprintf(stderr, "       %s grid_a.spg grid_b.spg [tile]\n", argv[0]);
+    return 2;
+}